@@ -1,7 +1,10 @@
 #include <App/DebugApp.h>
 #include <Logic/Display/display.h>
 #include <Logic/ImuLogic.h>
+#include <Logic/IrStats.h>
 #include <Service/Sched/Scheduler.h>
+#include <Service/Sched/SliceWatchdog.h>
+#include <Service/Sched/SysTimer.h>
 #include <Service/Sched/Task.h>
 #include <Util/uint_to_str.h>
 
@@ -52,7 +55,104 @@ void DebugAccelApp::MainTaskFn(void* unused) {
   display_set_mode_text(disp_buff_);
 }
 
+DebugSchedApp::DebugSchedApp() : index_(0) {}
+
+void DebugSchedApp::OnEntry() {
+  index_ = 0;
+  Show();
+}
+void DebugSchedApp::OnExit() {}
+void DebugSchedApp::OnButton(button_t button) {
+  switch (button) {
+    case BUTTON_BACK:
+      badge_controller.BackToMenu(this);
+      break;
+    case BUTTON_UP:
+      if (index_ > 0) index_--;
+      Show();
+      break;
+    case BUTTON_DOWN:
+      if (slice_watchdog.GetOverrun(index_ + 1)) index_++;
+      Show();
+      break;
+    case BUTTON_OK:
+      slice_watchdog.Reset();
+      index_ = 0;
+      Show();
+      break;
+    default:
+      break;
+  }
+}
+
+// "<count> P<prio> <ms>MS" for record index_, e.g. "3 P880 16MS".
+void DebugSchedApp::Show() {
+  OverrunRecord* record = slice_watchdog.GetOverrun(index_);
+  if (!record) {
+    display_set_mode_scroll_text("NO OVERRUN");
+    return;
+  }
+  size_t len = 0;
+  len += uint_to_chr(disp_buff_ + len, sizeof(disp_buff_) - len,
+                     slice_watchdog.GetOverrunCount());
+  disp_buff_[len++] = ' ';
+  disp_buff_[len++] = 'P';
+  len += uint_to_chr(disp_buff_ + len, sizeof(disp_buff_) - len,
+                     record->task->Prio());
+  disp_buff_[len++] = ' ';
+  len += uint_to_chr(disp_buff_ + len, sizeof(disp_buff_) - len,
+                     record->cycles / SysTimer::GetCyclesPerMs());
+  disp_buff_[len++] = 'M';
+  disp_buff_[len++] = 'S';
+  disp_buff_[len] = 0;
+  display_set_mode_scroll_text(disp_buff_);
+}
+
+DebugIrApp::DebugIrApp() : index_(0) {}
+
+void DebugIrApp::OnEntry() {
+  index_ = 0;
+  Show();
+}
+void DebugIrApp::OnExit() {}
+void DebugIrApp::OnButton(button_t button) {
+  switch (button) {
+    case BUTTON_BACK:
+      badge_controller.BackToMenu(this);
+      break;
+    case BUTTON_UP:
+      if (index_ > 0) index_--;
+      Show();
+      break;
+    case BUTTON_DOWN:
+      if (index_ + 1 < ir::IR_STATS_COUNT) index_++;
+      Show();
+      break;
+    case BUTTON_OK:
+      ir::IrStatsReset();
+      Show();
+      break;
+    default:
+      break;
+  }
+}
+
+// "<name> <count>" for counter index_, e.g. "BAD CRC 12".
+void DebugIrApp::Show() {
+  size_t len = 0;
+  for (const char* name = ir::IR_STATS_NAMES[index_]; *name; name++) {
+    disp_buff_[len++] = *name;
+  }
+  disp_buff_[len++] = ' ';
+  len += uint_to_chr(disp_buff_ + len, sizeof(disp_buff_) - len,
+                     ir::IrStatsGet(index_));
+  disp_buff_[len] = 0;
+  display_set_mode_scroll_text(disp_buff_);
+}
+
 DebugAccelApp g_debug_accel_app;
+DebugSchedApp g_debug_sched_app;
+DebugIrApp g_debug_ir_app;
 DebugApp g_debug_app;
 
 }  // namespace hitcon
@@ -27,8 +27,50 @@ class DebugAccelApp : public App {
 
 extern DebugAccelApp g_debug_accel_app;
 
+// Shows the scheduler's slice overrun log, newest first. Up/down to move
+// through it, OK to clear it.
+class DebugSchedApp : public App {
+ public:
+  DebugSchedApp();
+  virtual ~DebugSchedApp() = default;
+
+  void OnEntry() override;
+  void OnExit() override;
+  void OnButton(button_t button) override;
+
+ private:
+  size_t index_;
+  char disp_buff_[32];
+
+  void Show();
+};
+
+extern DebugSchedApp g_debug_sched_app;
+
+// Shows the IrStats counters one at a time. Up/down to move through them, OK
+// to clear them.
+class DebugIrApp : public App {
+ public:
+  DebugIrApp();
+  virtual ~DebugIrApp() = default;
+
+  void OnEntry() override;
+  void OnExit() override;
+  void OnButton(button_t button) override;
+
+ private:
+  size_t index_;
+  char disp_buff_[24];
+
+  void Show();
+};
+
+extern DebugIrApp g_debug_ir_app;
+
 constexpr menu_entry_t debug_menu_entries[] = {
-    {"Accel", &g_debug_accel_app, nullptr}};
+    {"Accel", &g_debug_accel_app, nullptr},
+    {"Sched", &g_debug_sched_app, nullptr},
+    {"IR", &g_debug_ir_app, nullptr}};
 
 constexpr size_t debug_menu_entries_len =
     sizeof(debug_menu_entries) / sizeof(debug_menu_entries[0]);
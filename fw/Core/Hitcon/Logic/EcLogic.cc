@@ -293,43 +293,41 @@ PointMultContext::PointMultContext() : p(g_generator), res(g_generator) {}
 PointMultService g_point_mult_service;
 
 PointMultService::PointMultService()
-    : routineTask(801, (task_callback_t)&PointMultService::routineFunc,
-                  (void *)this) {}
-
-void PointMultService::routineFunc() {
-  if (context.i == 128) {
-    callback(callbackArg1, &context.res);
-  } else {
-    if (context.i & 1) {
-      if (context.times & UINT64_MSB)
-        g_point_add_service.start(context.p, context.res,
-                                  (callback_t)&PointMultService::onAddDone,
-                                  this);
-      else
-        scheduler.Queue(&routineTask, this);
-      context.times <<= 1;
-    } else {
-      g_point_add_service.start(context.res, context.res,
+    : routineTask(801),
+      finalizeTask(801, (callback_t)&PointMultService::finalize, this) {}
+
+Coroutine PointMultService::routineFunc() {
+  for (int bit = 0; bit < 64; bit++) {
+    g_point_add_service.start(context.res, context.res,
+                              (callback_t)&PointMultService::onAddDone, this);
+    co_await WaitWake();
+    if (context.times & UINT64_MSB) {
+      g_point_add_service.start(context.p, context.res,
                                 (callback_t)&PointMultService::onAddDone, this);
+      co_await WaitWake();
     }
-    ++context.i;
+    context.times <<= 1;
   }
+  scheduler.Queue(&finalizeTask, this);
 }
 
 void PointMultService::onAddDone(EcPoint *res) {
   context.res = *res;
-  scheduler.Queue(&routineTask, this);
+  routineTask.Wake();
 }
 
+void PointMultService::finalize() { callback(callbackArg1, &context.res); }
+
 void PointMultService::start(const EcPoint &p, uint64_t times,
                              callback_t callback, void *callbackArg1) {
   context.p = p;
   context.times = times;
-  context.i = 0;
   context.res = EcPoint();
   this->callback = callback;
   this->callbackArg1 = callbackArg1;
-  scheduler.Queue(&routineTask, this);
+  // EcLogic has no way to retry, kCoFrames has a frame for this one.
+  bool ret = routineTask.Start(routineFunc());
+  my_assert(ret);
 }
 
 }  // namespace internal
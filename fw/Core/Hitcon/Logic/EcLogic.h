@@ -2,6 +2,7 @@
 #define SERVICE_EC_LOGIC_H_
 #include <Service/EcParams.h>
 #include <Service/HashService.h>
+#include <Service/Sched/Coroutine.h>
 #include <Service/Sched/Task.h>
 #include <Util/callback.h>
 #include <stdint.h>
@@ -146,8 +147,6 @@ struct PointMultContext {
   EcPoint p;
   uint64_t times;
   EcPoint res;
-  // The iterator.
-  uint8_t i;
   PointMultContext();
 };
 
@@ -161,9 +160,13 @@ class PointMultService {
   callback_t callback;
   void *callbackArg1;
   PointMultContext context;
-  service::sched::Task routineTask;
-  void routineFunc();
+  service::sched::CoTask routineTask;
+  // The callback may start another multiplication, so it runs in its own task
+  // after routineFunc() is done.
+  service::sched::Task finalizeTask;
+  service::sched::Coroutine routineFunc();
   void onAddDone(EcPoint *res);
+  void finalize();
 };
 
 extern PointMultService g_point_mult_service;
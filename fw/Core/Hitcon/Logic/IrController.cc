@@ -4,8 +4,10 @@
 #include <App/ShowNameApp.h>
 #include <Logic/BadgeController.h>
 #include <Logic/Display/display.h>
+#include <Logic/EntropyHub.h>
 #include <Logic/GameController.h>
 #include <Logic/IrController.h>
+#include <Logic/IrStats.h>
 #include <Logic/RandomPool.h>
 #include <Logic/XBoardLogic.h>
 #include <Service/HashService.h>
@@ -35,8 +37,9 @@ IrController::IrController()
       broadcast_task(800, (callback_t)&IrController::BroadcastIr, this),
       showtext_task(800, (callback_t)&IrController::ShowText, this),
       send_lock(true), recv_lock(true), disable_broadcast(false),
-      received_packet_cnt(0), priority_data_len_(0), current_hashing_slot(-1),
-      current_tx_slot(-1) {}
+      retx_task(800, (callback_t)&IrController::PumpRetransmit, this),
+      priority_data_len_(0), retx_queue(this), fragmenter(this),
+      message_callback(nullptr), message_callback_arg(nullptr) {}
 
 void IrController::ShowText(void* arg) {
   struct ShowPacket* pkt = reinterpret_cast<struct ShowPacket*>(arg);
@@ -56,11 +59,18 @@ void IrController::Init() {
 }
 
 void IrController::OnPacketReceived(void* arg) {
-  received_packet_cnt++;
-
   IrPacket* packet = reinterpret_cast<IrPacket*>(arg);
   IrData* data = reinterpret_cast<IrData*>(&packet->data_[1]);
 
+  // Retransmitted copies are handled once. Fragmenter sees every copy, it
+  // acknowledges a fragment sent again because the last ACK was lost, and
+  // resends what's missing on every ACK, even one the same as the last.
+  if (data->type != packet_type::kFragment &&
+      data->type != packet_type::kFragmentAck && dedup.Seen(packet->crc_)) {
+    g_ir_stats.rx_duplicates++;
+    return;
+  }
+
   // Game
   if (data->type == packet_type::kGame) {
     // removed
@@ -70,27 +80,33 @@ void IrController::OnPacketReceived(void* arg) {
     scheduler.Queue(&showtext_task, &data->opaq.show);
   } else if (data->type == packet_type::kAcknowledge) {
     OnAcknowledgePacket(&data->opaq.acknowledge);
+  } else if (data->type == packet_type::kMultiAcknowledge) {
+    if (packet->size_ > 1 + IR_DATA_HEADER_SIZE) {
+      OnMultiAcknowledgePacket(&data->opaq.multi_acknowledge,
+                               packet->size_ - 1 - IR_DATA_HEADER_SIZE);
+    }
   } else if (data->type == packet_type::kScoreAnnonce) {
     show_name_app.SetScore(
         *reinterpret_cast<uint32_t*>(data->opaq.score_announce.score));
+  } else if (data->type == packet_type::kFragment) {
+    if (packet->size_ > 1 + IR_DATA_HEADER_SIZE) {
+      fragmenter.OnFragment(data->opaq.fragment,
+                            packet->size_ - 1 - IR_DATA_HEADER_SIZE);
+    }
+  } else if (data->type == packet_type::kFragmentAck) {
+    fragmenter.OnFragmentAck(data->opaq.fragment_ack);
   }
 }
 
 void IrController::OnAcknowledgePacket(AcknowledgePacket* pckt) {
-  for (int i = 0; i < RETX_QUEUE_SIZE; i++) {
-    uint8_t status = queued_packets_[i].status;
-    if ((status & kRetransmitStatusMask) == kRetransmitStatusWaitTxSlot ||
-        (status & kRetransmitStatusMask) == kRetransmitStatusWaitAck) {
-      if (memcmp(queued_packets_[i].hash, pckt->packet_hash, PACKET_HASH_LEN) ==
-          0) {
-        AckTag ack = queued_packets_[i].ack_tag;
-        OnAcknowledgeTag(ack);
-        // Received, no longer need to retransmit.
-        queued_packets_[i].status =
-            (queued_packets_[i].status & (~kRetransmitStatusMask));
-      }
-    }
-  }
+  retx_queue.OnAcknowledge(pckt->packet_hash);
+}
+
+void IrController::OnMultiAcknowledgePacket(MultiAcknowledgePacket* pckt,
+                                            size_t len) {
+  size_t count = pckt->count;
+  if (count > MULTI_ACK_MAX || len < 1 + count * MULTI_ACK_HASH_LEN) return;
+  retx_queue.OnAcknowledgeMulti(&pckt->packet_hash[0][0], count);
 }
 
 void IrController::OnAcknowledgeTag(AckTag tag) {
@@ -108,147 +124,104 @@ int IrController::prob_f(int lf) { return v[0] * lf * lf + v[1] * lf + v[2]; }
 
 void IrController::RoutineTask(void* unused) {
   // remove generating random number
-  MaintainQueued();
+  retx_queue.Maintain();
+  fragmenter.Tick();
+  dedup.Tick();
 }
 
 void IrController::OnPacketHashResult(void* arg_ptr) {
-  my_assert(current_hashing_slot != -1);
-  my_assert(current_hashing_slot < RETX_QUEUE_SIZE);
   hitcon::hash::HashResult* hash_result =
       reinterpret_cast<hitcon::hash::HashResult*>(arg_ptr);
-  memcpy(&(queued_packets_[current_hashing_slot].hash[0]), hash_result->digest,
-         PACKET_HASH_LEN);
   my_assert(PACKET_HASH_LEN <= hash_result->size);
-  uint8_t status = queued_packets_[current_hashing_slot].status;
-  // Update status to Waiting for IrController's tx slot
-  status = (status & (~kRetransmitStatusMask)) | kRetransmitStatusWaitTxSlot;
-  queued_packets_[current_hashing_slot].status =
-      status;  // Update the struct member
-  current_hashing_slot = -1;
+  retx_queue.OnHashResult(hash_result->digest);
+  // The hash service is still running this callback, the next hash starts
+  // after it returns.
+  scheduler.Queue(&retx_task, nullptr);
 }
 
+void IrController::PumpRetransmit(void* unused) { retx_queue.Pump(); }
+
+void IrController::OnRetransmitOut(void* unused) { retx_queue.Pump(); }
+
 bool IrController::SendPacketWithRetransmit(uint8_t* data, size_t len,
                                             uint8_t retries, AckTag ack_tag) {
-  my_assert(len <= MAX_PACKET_PAYLOAD_BYTES);
-  my_assert(retries < 8);  // Max retries fits in 3 bits
-  for (int i = 0; i < RETX_QUEUE_SIZE; i++) {
-    // Check if slot is empty by checking the status mask
-    if ((queued_packets_[i].status & kRetransmitStatusMask) ==
-        kRetransmitStatusSlotUnused) {
-      // Slot is empty.
-      memcpy(&(queued_packets_[i].data[0]), data, len);
-      queued_packets_[i].size = len;
-      // Set status to Waiting for hashing processor and store retry limit
-      queued_packets_[i].status =
-          kRetransmitStatusWaitHashAvail | (retries & kRetransmitLimitMask);
-      queued_packets_[i].ack_tag = ack_tag;
-      return true;
-    }
+  return retx_queue.Push(data, len, retries, ack_tag);
+}
+
+bool IrController::StartHash(const uint8_t* data, size_t len) {
+  return hitcon::hash::g_hash_service.StartHash(
+      data, len, (callback_t)&IrController::OnPacketHashResult, this);
+}
+
+bool IrController::CanSend() { return irLogic.AvailableToSend(); }
+
+bool IrController::Send(uint8_t* data, size_t len) {
+  if (g_xboard_logic.GetConnectState() ==
+      UsartConnectState::ConnectBaseStn2025) {
+    return g_xboard_logic.SendIRPacket(data, len);
   }
-  return false;  // No empty slot found
+  return irLogic.SendPacket(data, len, TxPriority::kNormal,
+                            (callback_t)&IrController::OnRetransmitOut, this);
 }
 
-void IrController::MaintainQueued() {
-  if (irLogic.AvailableToSend()) {
-    current_tx_slot = -1;
+uint32_t IrController::Random() { return g_fast_random_pool.GetRandom(); }
+
+bool IrController::SendFragmented(const uint8_t* data, size_t len) {
+  if (!fragmenter.HasSender()) {
+    // Not in Init(), g_fast_random_pool isn't seeded by then and every badge
+    // would pick the same ID.
+    if (!g_entropy_hub.EntropyReady()) return false;
+    uint32_t random = Random();
+    fragmenter.Init(reinterpret_cast<uint8_t*>(&random), random >> 24);
   }
+  return fragmenter.Send(data, len);
+}
 
-  // Iterate through the queue slots in a randomized order.
-  for (int j = 0; j < RETX_QUEUE_SIZE; j++) {
-    // Randomize the slot index to avoid always checking/sending from the same
-    // slots first. Sending from the same slots first may result in scheduling
-    // starvation.
-    int i = (j + (g_fast_random_pool.GetRandom() % RETX_QUEUE_SIZE)) %
-            RETX_QUEUE_SIZE;
-
-    // Get the current status and other packet info.
-    uint8_t current_status = queued_packets_[i].status & kRetransmitStatusMask;
-    uint8_t pckt_size = queued_packets_[i].size;
-    // This is the payload data within the struct.
-    uint8_t* pckt_data = &(queued_packets_[i].data[0]);
-
-    if (current_status == kRetransmitStatusSlotUnused) {
-      // Slot is unused. Do nothing.
-    } else if (current_status == kRetransmitStatusWaitHashAvail) {
-      // Waiting for hash processor to be available.
-      if (current_hashing_slot == -1) {
-        // Start hashing the payload.
-        bool ret = hitcon::hash::g_hash_service.StartHash(
-            pckt_data, pckt_size, (callback_t)&IrController::OnPacketHashResult,
-            this);
-        if (ret) {
-          // Hashing started successfully. Update status to Waiting for hash
-          // processor to finish.
-          queued_packets_[i].status =
-              (queued_packets_[i].status & ~kRetransmitStatusMask) |
-              kRetransmitStatusWaitHashDone;
-          current_hashing_slot =
-              i;  // Mark this slot as being currently hashed.
-        }
-        // If ret is false, hash service was busy, will try again next
-        // RoutineTask cycle.
-      }
-    } else if (current_status == kRetransmitStatusWaitHashDone) {
-      // Waiting for hash processor to finish.
-      // The OnPacketHashResult callback will change the status to
-      // kRetransmitStatusWaitTxSlot once hashing is complete and the hash is
-      // stored. Do nothing here.
-    } else if (current_status == kRetransmitStatusWaitTxSlot) {
-      // Waiting for IrController's tx slot to open up. (Hash is ready)
-      if (current_tx_slot == -1) {
-        bool ret;
-        if (g_xboard_logic.GetConnectState() ==
-            UsartConnectState::ConnectBaseStn2025) {
-          ret = g_xboard_logic.SendIRPacket(&(queued_packets_[i].data[0]),
-                                            queued_packets_[i].size);
-        } else {
-          ret = irLogic.SendPacket(&(queued_packets_[i].data[0]),
-                                   queued_packets_[i].size);
-        }
-        if (ret) {
-          // Packet successfully queued for transmission by irLogic.
-          current_tx_slot =
-              i;  // Mark this slot as currently being transmitted.
-          // Update status to Waiting for ACK.
-          queued_packets_[i].status =
-              (queued_packets_[i].status & ~kRetransmitStatusMask) |
-              kRetransmitStatusWaitAck;
-          // Set the timer for waiting for an acknowledgment packet.
-          queued_packets_[i].time_to_retry =
-              600 + 200 - (g_fast_random_pool.GetRandom() % 400);
-        }
-        // If ret is false, irLogic was busy, will try again next RoutineTask
-        // cycle.
-      }
-    } else if (current_status == kRetransmitStatusWaitAck) {
-      // Waiting for ACK. Check the retry timer.
-      if (queued_packets_[i].time_to_retry == 0) {
-        // Timer elapsed, no ACK received. Check if retries are left.
-        uint8_t counts = queued_packets_[i].status &
-                         kRetransmitLimitMask;  // Get remaining retry count.
-        if (counts == 0) {
-          // No more retries left. Mark this slot as unused.
-          queued_packets_[i].status = kRetransmitStatusSlotUnused;
-        } else {
-          // Retries left. Decrement the count and transition back to waiting
-          // for TX slot.
-          counts--;
-          // Preserve the new count and retransmit.
-          queued_packets_[i].status =
-              (queued_packets_[i].status & ~kRetransmitLimitMask) |
-              counts;  // Update retry count.
-          queued_packets_[i].status =
-              (queued_packets_[i].status & ~kRetransmitStatusMask) |
-              kRetransmitStatusWaitTxSlot;  // Update status.
-        }
-      } else {
-        // Timer is still counting down. Decrement it.
-        queued_packets_[i].time_to_retry--;
-      }
-    }
+void IrController::SetOnFragmentedMessage(callback_t callback,
+                                          void* callback_arg1) {
+  message_callback = callback;
+  message_callback_arg = callback_arg1;
+}
+
+bool IrController::SendFragment(const FragmentPacket& packet, size_t len) {
+  IrData irdata = {
+      .ttl = 0,
+      .type = packet_type::kFragment,
+  };
+  memcpy(&irdata.opaq.fragment, &packet, len);
+  size_t irdata_len = IR_DATA_HEADER_SIZE + len;
+  if (g_xboard_logic.GetConnectState() ==
+      UsartConnectState::ConnectBaseStn2025) {
+    return g_xboard_logic.SendIRPacket(reinterpret_cast<uint8_t*>(&irdata),
+                                       irdata_len);
   }
+  return irLogic.SendPacket(reinterpret_cast<uint8_t*>(&irdata), irdata_len,
+                            TxPriority::kNormal,
+                            (callback_t)&IrController::OnFragmentOut, this);
 }
 
+bool IrController::SendFragmentAck(const FragmentAckPacket& ack) {
+  IrData irdata = {
+      .ttl = 0,
+      .type = packet_type::kFragmentAck,
+  };
+  memcpy(&irdata.opaq.fragment_ack, &ack, sizeof(ack));
+  return Send(reinterpret_cast<uint8_t*>(&irdata),
+              IR_DATA_HEADER_SIZE + sizeof(ack));
+}
+
+void IrController::OnMessage(const uint8_t* data, size_t len) {
+  if (!message_callback) return;
+  FragmentMessage message = {.data = data, .len = len};
+  message_callback(message_callback_arg, &message);
+}
+
+void IrController::OnMessageSent(bool acked) {
+  // Nobody waits on it yet, SendFragmented() callers see Busy() clear.
+}
+
+void IrController::OnFragmentOut(void* unused) { fragmenter.Pump(); }
+
 void IrController::BroadcastIr(void* unused) {
   if (disable_broadcast) return;
 
@@ -273,9 +246,10 @@ void IrController::SendShowPacket(char* msg) {
 bool IrController::TrySendPriority() {
   if (priority_data_len_ == 0) return true;
 
-  uint8_t irdata_len = sizeof(priority_data_) / sizeof(uint8_t);
+  // Only show packets are sent this way, not the whole union.
+  uint8_t irdata_len = IR_DATA_HEADER_SIZE + sizeof(ShowPacket);
   bool ret = irLogic.SendPacket(reinterpret_cast<uint8_t*>(&priority_data_),
-                                irdata_len);
+                                irdata_len, TxPriority::kHigh);
   if (ret) {
     priority_data_len_ = 0;
   }
@@ -2,7 +2,10 @@
 #define LOGIC_IRCONTROLLER_DOT_H_
 
 #include <Logic/EcLogic.h>
+#include <Logic/IrDedup.h>
+#include <Logic/IrFragment.h>
 #include <Logic/IrLogic.h>
+#include <Logic/IrRetransmit.h>
 #include <Service/EcParams.h>
 #include <Service/IrService.h>
 #include <Service/Sched/PeriodicTask.h>
@@ -21,7 +24,10 @@ enum class packet_type : uint8_t {
   kTwoBadgeActivity = 6,
   kScoreAnnonce = 7,
   kSingleBadgeActivity = 8,
-  kSponsorActivity = 9
+  kSponsorActivity = 9,
+  kFragment = 10,
+  kFragmentAck = 11,
+  kMultiAcknowledge = 12
 };
 
 namespace hitcon {
@@ -37,7 +43,6 @@ struct ShowPacket {
   char message[16];
 };
 
-constexpr size_t PACKET_HASH_LEN = 6;
 // Currently we set the username to be the lower 32 bit (first 4 bytes in
 // little-endian) of public key. Might switch to the hash of pubkey if there's
 // concerns of collisions.
@@ -49,6 +54,14 @@ struct AcknowledgePacket {
   uint8_t packet_hash[PACKET_HASH_LEN];
 };
 
+// This packet acknowledges several packets at once, from any badges, so the
+// base station pays for one frame instead of one per packet.
+struct MultiAcknowledgePacket {
+  uint8_t count;
+  // The first MULTI_ACK_HASH_LEN bytes of the hash of each packet.
+  uint8_t packet_hash[MULTI_ACK_MAX][MULTI_ACK_HASH_LEN];
+};
+
 // This packet is from the badge, saying I'm here to the base station.
 struct ProximityPacket {
   uint8_t user[IR_USERNAME_LEN];
@@ -121,46 +134,25 @@ struct IrData {
     struct GamePacket game;
     struct ShowPacket show;
     struct AcknowledgePacket acknowledge;
+    struct MultiAcknowledgePacket multi_acknowledge;
     struct ProximityPacket proximity;
     struct PubAnnouncePacket pub_announce;
     struct TwoBadgeActivityPacket two_activity;
     struct ScoreAnnouncePacket score_announce;
     struct SingleBadgeActivityPacket single_activity;
     struct SponsorActivityPacket sponsor_activity;
+    struct FragmentPacket fragment;
+    struct FragmentAckPacket fragment_ack;
   } opaq;
 };
-
-constexpr size_t RETX_QUEUE_SIZE = 4;
-
-constexpr uint8_t kRetransmitLimitMask = 0x07;
-constexpr uint8_t kRetransmitStatusMask = 0xe0;
-constexpr uint8_t kRetransmitStatusSlotUnused = 0x00;
-constexpr uint8_t kRetransmitStatusWaitHashAvail = 0x20;
-constexpr uint8_t kRetransmitStatusWaitHashDone = 0x40;
-constexpr uint8_t kRetransmitStatusWaitTxSlot = 0x80;
-constexpr uint8_t kRetransmitStatusWaitAck = 0xA0;
-
-enum class AckTag : uint8_t {
-  ACK_TAG_NONE = 0,
-  ACK_TAG_PUBKEY_RECOG = 1,
-};
-
-struct RetransmittableIrPacket {
-  uint8_t status;
-  // 0x07 - retransmit limit left.
-  // 0xe0 - Status
-  //   - 0x00 Slot is unused.
-  //   - 0x20 Waiting for hashing processor to be available.
-  //   - 0x40 Waiting for hashing processor to finish.
-  //   - 0x80 Waiting for IrController's tx slot to open up.
-  //   - 0xA0 Waiting for Ack.
-  AckTag ack_tag;
-  // Ack tag is used internally to denote special events.
-  uint16_t time_to_retry;
-  // In units of IR Retry task calls.
-  uint8_t size;
-  uint8_t data[MAX_PACKET_PAYLOAD_BYTES + 4];
-  uint8_t hash[PACKET_HASH_LEN];
+// The largest payload IrDecoder delivers, with the size byte and the checksum
+// below MAX_PACKET_PAYLOAD_BYTES.
+static_assert(sizeof(IrData) + 3 <= MAX_PACKET_PAYLOAD_BYTES);
+
+// A message from SendFragmented() on another badge.
+struct FragmentMessage {
+  const uint8_t* data;
+  size_t len;
 };
 
 class IrController {
@@ -181,6 +173,16 @@ class IrController {
   bool SendPacketWithRetransmit(uint8_t* data, size_t len, uint8_t retries,
                                 AckTag ack_tag);
 
+  // Send a message of up to FRAGMENT_MAX_MESSAGE bytes in fragments, the
+  // receiver acknowledges them and the missing ones are sent again.
+  // Return false if the last message is still being sent, or the random pool
+  // isn't seeded yet for our sender ID.
+  bool SendFragmented(const uint8_t* data, size_t len);
+
+  // callback(callback_arg1, FragmentMessage*) on every message from
+  // SendFragmented() on another badge.
+  void SetOnFragmentedMessage(callback_t callback, void* callback_arg1);
+
  private:
   bool send_lock;
   bool recv_lock;
@@ -188,19 +190,25 @@ class IrController {
   uint8_t v[3] = {1, 27, 111};
   bool disable_broadcast;
 
-  // Number of packets received, primarily for debugging.
-  size_t received_packet_cnt;
+  DuplicateFilter dedup;
 
   hitcon::service::sched::PeriodicTask routine_task;
   hitcon::service::sched::Task showtext_task;
   hitcon::service::sched::Task broadcast_task;
+  // Pumps retx_queue once the hash service is free again.
+  hitcon::service::sched::Task retx_task;
 
   IrData priority_data_;
   size_t priority_data_len_;
 
-  RetransmittableIrPacket queued_packets_[RETX_QUEUE_SIZE];
-  int current_hashing_slot;
-  int current_tx_slot;
+  friend class RetransmitQueue<IrController>;
+  RetransmitQueue<IrController> retx_queue;
+
+  friend class Fragmenter<IrController>;
+  Fragmenter<IrController> fragmenter;
+
+  callback_t message_callback;
+  void* message_callback_arg;
 
   // Called every 1s.
   void RoutineTask(void* unused);
@@ -215,16 +223,31 @@ class IrController {
 
   bool TrySendPriority();
 
-  // Periodic check on queued_packets_
-  void MaintainQueued();
-
   // Called when we received an acknowledgment packet.
   void OnAcknowledgePacket(AcknowledgePacket* pckt);
+  // Same for an aggregated one, len is its size in the packet.
+  void OnMultiAcknowledgePacket(MultiAcknowledgePacket* pckt, size_t len);
   // Called by HashProcessor when hashing finished.
   void OnPacketHashResult(void* hash_result);
-
+  void PumpRetransmit(void* unused);
+  // Called by IrLogic when a packet from Send() is on the air.
+  void OnRetransmitOut(void* unused);
+
+  // Port of retx_queue, see RetransmitQueue.
+  bool StartHash(const uint8_t* data, size_t len);
+  bool CanSend();
+  bool Send(uint8_t* data, size_t len);
   // Called whenever we've some acknowledged packet.
   void OnAcknowledgeTag(AckTag tag);
+  uint32_t Random();
+
+  // Port of fragmenter, see Fragmenter.
+  bool SendFragment(const FragmentPacket& packet, size_t len);
+  bool SendFragmentAck(const FragmentAckPacket& ack);
+  void OnMessage(const uint8_t* data, size_t len);
+  void OnMessageSent(bool acked);
+  // Called by IrLogic when a fragment is on the air.
+  void OnFragmentOut(void* unused);
 };
 
 extern IrController irController;
@@ -0,0 +1,299 @@
+#include "IrDecoder.h"
+
+#include <Logic/IrFec.h>
+#include <Logic/IrStats.h>
+#include <Logic/crc32.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hitcon {
+namespace ir {
+
+namespace {
+
+static_assert(DECODE_SAMPLE_RATIO == 4, "The table assumes 2 bits per byte");
+
+constexpr uint8_t kBitInvalid = 0b100;
+
+// Same rule as DECODE_SAMPLE_RATIO_THRESHOLD: 3 or 4 of the samples on is a 1,
+// 0 or 1 on is a 0, anything else is invalid.
+constexpr uint8_t DecodeNibble(unsigned nibble) {
+  unsigned cnt = 0;
+  for (unsigned i = 0; i < 4; i++) cnt += (nibble >> i) & 1;
+  if (cnt >= DECODE_SAMPLE_RATIO_THRESHOLD) return 1;
+  if (cnt <= DECODE_SAMPLE_RATIO - DECODE_SAMPLE_RATIO_THRESHOLD) return 0;
+  return kBitInvalid;
+}
+
+// Maps 8 samples to bit 0 = first data bit, bit 1 = second data bit, with
+// kBitInvalid set if either is invalid.
+struct DecodeTable {
+  uint8_t entry[256];
+
+  constexpr DecodeTable() : entry() {
+    for (unsigned i = 0; i < 256; i++) {
+      uint8_t lo = DecodeNibble(i & 0xF);
+      uint8_t hi = DecodeNibble(i >> 4);
+      entry[i] = ((lo | hi) & kBitInvalid) | (lo & 1) | ((hi & 1) << 1);
+    }
+  }
+};
+
+constexpr DecodeTable kDecodeTable;
+
+constexpr unsigned BitWidth(size_t x) {
+  unsigned n = 0;
+  while (x) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+
+// Samples in the header patterns.
+constexpr unsigned kHeaderLen = BitWidth(IR_PACKET_HEADER_PACKED);
+constexpr unsigned kFastHeaderLen = BitWidth(IR_PACKET_HEADER_FAST_PACKED);
+static_assert(kHeaderLen + 8 <= 32 && kFastHeaderLen + 8 <= 32);
+
+// The packed headers have the newest sample at the LSB, the window has it at
+// the MSB.
+constexpr uint32_t Reverse(size_t x, unsigned len) {
+  uint32_t ret = 0;
+  for (unsigned i = 0; i < len; i++) {
+    ret = (ret << 1) | ((x >> i) & 1);
+  }
+  return ret;
+}
+
+constexpr uint32_t kHeader =
+    Reverse(IR_PACKET_HEADER_PACKED & IR_PACKET_HEADER_MASK, kHeaderLen);
+constexpr uint32_t kHeaderMask = Reverse(IR_PACKET_HEADER_MASK, kHeaderLen);
+constexpr uint32_t kFastHeader = Reverse(
+    IR_PACKET_HEADER_FAST_PACKED & IR_PACKET_HEADER_FAST_MASK, kFastHeaderLen);
+constexpr uint32_t kFastHeaderMask =
+    Reverse(IR_PACKET_HEADER_FAST_MASK, kFastHeaderLen);
+
+// Shift of the window that lines up a header ending at the first sample of
+// the newest byte (bit 24) with kHeader, and with kFastHeader.
+constexpr unsigned kHeaderShift = 24 + 1 - kHeaderLen;
+constexpr unsigned kFastHeaderShift = 24 + 1 - kFastHeaderLen;
+
+// Both headers end in 4 samples on and before them 4 off, with the last
+// sample and the 2 between them don't care, so only sample offsets that have
+// these are compared.
+constexpr size_t kHeaderTailOn = 0b0000'00'1111'0;
+constexpr size_t kHeaderTailOff = 0b1111'00'0000'0;
+constexpr bool HasTail(size_t packed, size_t mask) {
+  return (packed & mask & kHeaderTailOn) == kHeaderTailOn &&
+         (mask & kHeaderTailOff) == kHeaderTailOff &&
+         (packed & kHeaderTailOff) == 0;
+}
+static_assert(HasTail(IR_PACKET_HEADER_PACKED, IR_PACKET_HEADER_MASK));
+static_assert(
+    HasTail(IR_PACKET_HEADER_FAST_PACKED, IR_PACKET_HEADER_FAST_MASK));
+
+// 8 samples of IrPhy::kFast to 4 data bits, the first sample of each pair.
+// Sets invalid if the other one differs.
+uint8_t DecodeFast(uint8_t samples, bool *invalid) {
+  *invalid = (samples ^ (samples >> 1)) & 0x55;
+  uint8_t bits = samples & 0x55;
+  bits = (bits | (bits >> 1)) & 0x33;
+  return (bits | (bits >> 2)) & 0x0F;
+}
+
+// The checksum byte of crc32 x.
+uint8_t FoldChecksum(uint32_t x) {
+  uint8_t ret = 0;
+  for (int i = 0; i < 32; i += 8) {
+    ret ^= (x & (0xffu << i)) >> i;
+  }
+  return ret;
+}
+
+}  // namespace
+
+uint8_t PacketChecksum(const uint8_t *data, size_t len) {
+  return FoldChecksum(crc32(data, len));
+}
+
+void EncodePacket(const uint8_t *data, size_t len, IrPacket &packet,
+                  bool fec) {
+  uint8_t *out = packet.data_;
+  if (fec) *out++ = IR_FEC_MARK;
+  // size included
+  size_t size = len + 2 + (fec ? IR_FEC_PARITY_BYTES : 0);
+  out[0] = static_cast<uint8_t>(size);
+  memcpy(out + 1, data, len * sizeof(data[0]));
+  const uint8_t chksum = PacketChecksum(out, len + 1);
+  out[len + 1] = chksum;
+  if (fec) FecEncode(out, len + 2, &out[len + 2]);
+  packet.size_ = out - packet.data_ + size;
+}
+
+IrDecoder::IrDecoder()
+    : callback(nullptr), callback_arg(nullptr), window(0), in_packet(false),
+      pending(0), pending_count(0), out(0), out_count(0), out_erased(false),
+      fec(false), erased_count(0) {}
+
+void IrDecoder::SetOnPacket(callback_t callback, void *callback_arg1) {
+  this->callback = callback;
+  this->callback_arg = callback_arg1;
+}
+
+void IrDecoder::FindHeader(uint8_t byte) {
+  window = (window >> 8) | (static_cast<uint32_t>(byte) << 24);
+  // Bit i is set if the samples before sample i of byte look like the end of
+  // a header, see kHeaderTailOn. Most buffers are silence or noise and have
+  // none.
+  uint32_t on = window & (window >> 1) & (window >> 2) & (window >> 3);
+  uint32_t off = ~(window | (window >> 1) | (window >> 2) | (window >> 3));
+  uint32_t ends = (on >> 20) & (off >> 14) & 0xFF;
+  while (ends) {
+    // Header ending at sample i of byte.
+    unsigned i = __builtin_ctz(ends);
+    ends &= ends - 1;
+    IrPhy phy;
+    if (((window >> (kHeaderShift + i)) & kHeaderMask) == kHeader) {
+      phy = IrPhy::kNormal;
+    } else if (((window >> (kFastHeaderShift + i)) & kFastHeaderMask) ==
+               kFastHeader) {
+      phy = IrPhy::kFast;
+    } else {
+      continue;
+    }
+    g_ir_stats.rx_headers++;
+    in_packet = true;
+    pending = byte >> (i + 1);
+    pending_count = 7 - i;
+    out = 0;
+    out_count = 0;
+    out_erased = false;
+    fec = false;
+    packet.size_ = 0;
+    packet.phy_ = phy;
+    return;
+  }
+}
+
+void IrDecoder::PushByte(uint8_t byte) {
+  if (packet.size_ == 0) {
+    if (byte == IR_FEC_MARK && !fec) {
+      // The size byte comes next.
+      fec = true;
+      return;
+    }
+    // Size byte, counts itself, the checksum and the parity.
+    size_t parity = fec ? IR_FEC_PARITY_BYTES : 0;
+    if (byte < 2 + parity || byte >= MAX_PACKET_PAYLOAD_BYTES + parity) {
+      // Packet too large, or too small to have a checksum.
+      g_ir_stats.rx_bad_size++;
+      EndPacket();
+      return;
+    }
+    packet.data_[0] = byte;
+    packet.size_ = 1;
+    erased_count = 0;
+    return;
+  }
+  if (out_erased) {
+    if (erased_count == IR_FEC_PARITY_BYTES) {
+      // More than FEC can fix.
+      g_ir_stats.rx_invalid_fec++;
+      EndPacket();
+      return;
+    }
+    erased[erased_count++] = packet.size_;
+  }
+  packet.data_[packet.size_++] = byte;
+  if (packet.size_ < packet.data_[0]) return;
+
+  if (fec) {
+    if (!FecCorrect(packet.data_, packet.size_, erased, erased_count)) {
+      g_ir_stats.rx_fec_failed++;
+      EndPacket();
+      return;
+    }
+    if (erased_count) g_ir_stats.rx_fec_fixed++;
+    packet.size_ -= IR_FEC_PARITY_BYTES;
+  }
+  uint32_t crc = crc32(packet.data_, packet.size_ - 1);
+  if (FoldChecksum(crc) == packet.data_[packet.size_ - 1]) {
+    packet.crc_ = crc;
+    // pop checksum
+    packet.data_[packet.size_ - 1] = '\0';
+    packet.size_--;
+    packet.data_[0] = packet.size_;
+    g_ir_stats.rx_packets++;
+    if (callback) callback(callback_arg, &packet);
+  } else {
+    g_ir_stats.rx_bad_checksum++;
+  }
+  EndPacket();
+}
+
+void IrDecoder::EndPacket() {
+  in_packet = false;
+  // Samples left in the byte are dropped, they're before the next header's
+  // lead in anyway.
+  window = 0;
+}
+
+void IrDecoder::Push(uint8_t byte) {
+  if (!in_packet) {
+    FindHeader(byte);
+    return;
+  }
+  pending |= static_cast<uint32_t>(byte) << pending_count;
+  uint8_t samples = pending & 0xFF;
+  pending >>= 8;
+  uint8_t bits;
+  bool invalid;
+  if (packet.phy_ == IrPhy::kFast) {
+    bits = DecodeFast(samples, &invalid);
+  } else {
+    bits = kDecodeTable.entry[samples];
+    invalid = bits & kBitInvalid;
+    bits &= ~kBitInvalid;
+  }
+  if (invalid) {
+    if (!fec || packet.size_ == 0) {
+      // decode error, FEC doesn't cover the size byte
+      if (packet.size_ == 0) {
+        g_ir_stats.rx_invalid_size++;
+      } else {
+        g_ir_stats.rx_invalid_data++;
+      }
+      EndPacket();
+      return;
+    }
+    out_erased = true;
+  }
+  out |= bits << out_count;
+  out_count += packet.phy_ == IrPhy::kFast ? 4 : 2;
+  if (out_count == 8) {
+    PushByte(out);
+    out = 0;
+    out_count = 0;
+    out_erased = false;
+  }
+}
+
+void IrDecoder::Decode(const uint8_t *buffer, size_t len) {
+  for (size_t i = 0; i < len; i++) Push(buffer[i]);
+}
+
+void IrDecoder::PushSilence(size_t bytes) {
+  while (bytes) {
+    bool was_in_packet = in_packet;
+    Push(0);
+    bytes--;
+    // A header can end in the first zero byte but not in any later one, its
+    // last 4 on samples would be in there.
+    if (!was_in_packet && !in_packet) break;
+  }
+  window = bytes >= sizeof(window) ? 0 : window >> (8 * bytes);
+}
+
+}  // namespace ir
+}  // namespace hitcon
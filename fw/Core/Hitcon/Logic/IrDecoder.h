@@ -0,0 +1,133 @@
+#ifndef HITCON_LOGIC_IR_DECODER_H_
+#define HITCON_LOGIC_IR_DECODER_H_
+
+#include <Service/IrParam.h>
+#include <Util/callback.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hitcon {
+
+namespace ir {
+
+struct IrPacket {
+  // IR Packet
+  // | header | data (1 byte size + n bytes data + 1 byte checksum) |
+  // With FEC, data is IR_FEC_MARK, then the above, then IR_FEC_PARITY_BYTES.
+
+  IrPacket() : size_(0), crc_(0), phy_(IrPhy::kNormal) {}
+
+  // We need to add 3 bytes because we need
+  // at least 1 byte to accomodate the size.
+  // at least 1 byte to accomodate the chksum.
+  uint8_t data_[MAX_PACKET_PAYLOAD_BYTES + 4];
+  size_t size_;
+  // crc32 behind the checksum of a decoded packet, tells packets apart.
+  uint32_t crc_;
+  // The header it came in with, or goes out with.
+  IrPhy phy_;
+};
+
+// Checksum byte of a packet over data_[0, len).
+uint8_t PacketChecksum(const uint8_t *data, size_t len);
+
+// Fill packet with the size byte, data and checksum, and the FEC parity if
+// fec, ready to send.
+void EncodePacket(const uint8_t *data, size_t len, IrPacket &packet,
+                  bool fec = false);
+
+// Packs 8 RX DMA bytes, the low byte of GPIOA IDR at each sample, into a byte
+// of samples for IrDecoder, LSB first. The receiver pulls IR_RX_IDR_BIT low
+// while it sees the carrier, that's a 1.
+inline uint8_t PackRxSamples(const uint8_t *idr) {
+  uint32_t lo, hi;
+  memcpy(&lo, idr, sizeof(lo));
+  memcpy(&hi, idr + 4, sizeof(hi));
+  // Little endian, the bit of each byte lands in bits 24 to 27, the other
+  // products stay clear of them.
+  lo = (((lo >> IR_RX_IDR_BIT) & 0x01010101) * 0x01020408) >> 24;
+  hi = (((hi >> IR_RX_IDR_BIT) & 0x01010101) * 0x01020408) >> 24;
+  return ~(lo | (hi << 4));
+}
+
+/*
+Decodes the RX sample stream into IrPacket.
+
+Samples come in bytes, LSB first, DECODE_SAMPLE_RATIO samples per data bit,
+or DECODE_SAMPLE_RATIO_FAST for IrPhy::kFast. The decoder works a whole byte at
+a time:
+- The header is searched for by shifting the byte into a 32 bit window and
+  comparing the window at each of the 8 sample offsets against
+  IR_PACKET_HEADER_PACKED and IR_PACKET_HEADER_FAST_PACKED, which one matched
+  is the packet's phy_.
+- Once found, the samples after the header are realigned so every step has 8
+  samples of exactly two data bits, and a 256 entry table gives both bits and
+  whether either is invalid. For IrPhy::kFast it's four data bits, a few
+  shifts pick one sample of each pair and check the other agrees.
+- An invalid bit ends a plain packet. In a FEC packet its byte is an erasure
+  for FecCorrect(), as long as there are no more than IR_FEC_PARITY_BYTES.
+
+Has no hardware dependency so it can be tested on the host.
+*/
+class IrDecoder {
+ public:
+  IrDecoder();
+
+  // Called with IrPacket* for every packet with a good checksum. The checksum
+  // and FEC parity are already removed and data_[0] is the new size_. The
+  // packet is only valid during the callback.
+  void SetOnPacket(callback_t callback, void *callback_arg1);
+
+  // Feed one byte of samples.
+  void Push(uint8_t byte);
+
+  // Feed len bytes of samples.
+  void Decode(const uint8_t *buffer, size_t len);
+
+  // Same as feeding bytes all zero bytes, but only does work for the part
+  // that can still finish a packet.
+  void PushSilence(size_t bytes);
+
+  // In the middle of a packet?
+  bool InPacket() { return in_packet; }
+
+ private:
+  callback_t callback;
+  void *callback_arg;
+
+  // Last 32 samples, newest at the MSB. Only used for header search.
+  uint32_t window;
+
+  bool in_packet;
+  // Samples received but not yet decoded, the oldest at the LSB.
+  uint32_t pending;
+  // Number of samples in pending, doesn't change during a packet.
+  uint8_t pending_count;
+  // Data bits decoded so far for the next byte, LSB first.
+  uint8_t out;
+  uint8_t out_count;
+  // out has an invalid bit.
+  bool out_erased;
+
+  // The packet started with IR_FEC_MARK.
+  bool fec;
+  // Indices into packet.data_ of erased bytes.
+  uint8_t erased[IR_FEC_PARITY_BYTES];
+  uint8_t erased_count;
+
+  IrPacket packet;
+
+  // Shift byte into window and start a packet if it completes a header.
+  void FindHeader(uint8_t byte);
+
+  // Store a decoded byte, ends the packet after its checksum.
+  void PushByte(uint8_t byte);
+
+  void EndPacket();
+};
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_DECODER_H_
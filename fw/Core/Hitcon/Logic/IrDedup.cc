@@ -0,0 +1,33 @@
+#include <Logic/IrDedup.h>
+
+namespace hitcon {
+namespace ir {
+
+DuplicateFilter::DuplicateFilter() : next(0) {
+  for (size_t i = 0; i < DEDUP_SLOTS; i++) {
+    fingerprints[i] = 0;
+    ttl[i] = 0;
+  }
+}
+
+bool DuplicateFilter::Seen(uint32_t fingerprint) {
+  for (size_t i = 0; i < DEDUP_SLOTS; i++) {
+    if (ttl[i] && fingerprints[i] == fingerprint) {
+      ttl[i] = DEDUP_TICKS;
+      return true;
+    }
+  }
+  fingerprints[next] = fingerprint;
+  ttl[next] = DEDUP_TICKS;
+  next = (next + 1) % DEDUP_SLOTS;
+  return false;
+}
+
+void DuplicateFilter::Tick() {
+  for (size_t i = 0; i < DEDUP_SLOTS; i++) {
+    if (ttl[i]) ttl[i]--;
+  }
+}
+
+}  // namespace ir
+}  // namespace hitcon
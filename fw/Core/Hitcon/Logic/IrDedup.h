@@ -0,0 +1,53 @@
+#ifndef HITCON_LOGIC_IR_DEDUP_H_
+#define HITCON_LOGIC_IR_DEDUP_H_
+
+#include <Logic/IrRetransmit.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+constexpr size_t DEDUP_SLOTS = 16;
+// In Tick() calls, 1s each from IrController. Covers the longest wait of
+// RetransmitQueue between two copies, plus a few ticks for the phase of the
+// two clocks and the time the copy spends in IrTxQueue.
+constexpr uint16_t DEDUP_TICKS = RETX_RETRY_TICKS + RETX_RETRY_JITTER + 10;
+
+/*
+Remembers the fingerprints of the last DEDUP_SLOTS packets for DEDUP_TICKS,
+so IrController handles each retransmitted copy once. The fingerprint is the
+crc32 IrDecoder already has in IrPacket::crc_. Each copy starts the window
+again, so every retry of a packet is caught, not just the first.
+
+The window only holds while fewer than DEDUP_SLOTS other packets come in,
+the oldest fingerprint makes room for a new one. In a busy room a copy may go
+through again.
+
+A packet seen again after DEDUP_TICKS without a copy in between goes through,
+so the same content sent on purpose later isn't lost.
+*/
+class DuplicateFilter {
+ public:
+  DuplicateFilter();
+
+  // Returns true if fingerprint was seen in the window, otherwise remembers
+  // it.
+  bool Seen(uint32_t fingerprint);
+
+  // Every 1s.
+  void Tick();
+
+ private:
+  uint32_t fingerprints[DEDUP_SLOTS];
+  // Ticks left for each, 0 if the slot is free.
+  uint16_t ttl[DEDUP_SLOTS];
+  // Slot the next new fingerprint goes to, the oldest.
+  uint8_t next;
+};
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_DEDUP_H_
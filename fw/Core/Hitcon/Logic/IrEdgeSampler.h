@@ -0,0 +1,94 @@
+#ifndef HITCON_LOGIC_IR_EDGE_SAMPLER_H_
+#define HITCON_LOGIC_IR_EDGE_SAMPLER_H_
+
+#include <Service/IrParam.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+/*
+Turns IR edge timestamps back into the sample bytes the GPIO sampling receiver
+produces, so the input capture receiver can share IrDecoder.
+
+Timestamps are 16 bit timer ticks of IR_TICKS_PER_SAMPLE per sample. Sample s
+covers ticks [4s, 4s + 4) and reads the line at tick 4s + 2, like the sampling
+receiver reads it once per sample period. Output goes to Sink:
+- Sink::OnRxByte(uint8_t byte) for a byte of 8 samples, LSB first.
+- Sink::OnRxSilence(size_t bytes) for that many all off bytes in a row, so
+  long silence costs the same as short silence.
+
+Calls must be at most 2^14 samples (about 1.7s) apart, or they alias.
+*/
+template <class Sink>
+class IrEdgeSampler {
+ public:
+  IrEdgeSampler() : pos(0), level(0), byte(0), bits(0) {}
+
+  // Samples from the last call up to tick, not including tick.
+  uint16_t SamplesUntil(uint16_t tick) {
+    return (SampleAt(tick) - pos) & kPosMask;
+  }
+
+  // Line level since the last edge, 1 is on.
+  uint8_t Level() { return level; }
+
+  // The line changed to new_level at tick.
+  void Edge(uint16_t tick, uint8_t new_level, Sink *sink) {
+    Emit(SamplesUntil(tick), sink);
+    level = new_level;
+  }
+
+  // No edge up to tick.
+  void Advance(uint16_t tick, Sink *sink) { Emit(SamplesUntil(tick), sink); }
+
+ private:
+  static_assert(IR_TICKS_PER_SAMPLE == 4);
+  static constexpr uint16_t kPosMask = 0xFFFF >> 2;
+
+  // Index of the first sample read at or after tick.
+  static uint16_t SampleAt(uint16_t tick) {
+    return static_cast<uint16_t>(tick + 1) >> 2;
+  }
+
+  void Emit(uint16_t n, Sink *sink) {
+    pos = (pos + n) & kPosMask;
+    // Finish the partial byte.
+    while (n && bits) {
+      byte |= level << bits;
+      bits++;
+      n--;
+      if (bits == 8) {
+        sink->OnRxByte(byte);
+        byte = 0;
+        bits = 0;
+      }
+    }
+    if (n >= 8) {
+      if (level) {
+        for (uint16_t i = 0; i < n / 8; i++) sink->OnRxByte(0xFF);
+      } else {
+        sink->OnRxSilence(n / 8);
+      }
+      n %= 8;
+    }
+    if (n) {
+      byte = level ? (1 << n) - 1 : 0;
+      bits = n;
+    }
+  }
+
+  // Sample index of the next sample to emit, modulo kPosMask + 1.
+  uint16_t pos;
+  uint8_t level;
+  // Samples of the byte being built, LSB first.
+  uint8_t byte;
+  uint8_t bits;
+};
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_EDGE_SAMPLER_H_
@@ -0,0 +1,108 @@
+#include <Logic/IrFec.h>
+
+namespace hitcon {
+namespace ir {
+
+namespace {
+
+static_assert(IR_FEC_PARITY_BYTES == 2, "Generator and decoder assume 2");
+
+// x^8 + x^4 + x^3 + x^2 + 1, alpha is 2.
+constexpr uint8_t kPoly = 0x1D;
+
+// Multiply by alpha.
+uint8_t Xtime(uint8_t x) { return (x << 1) ^ ((x & 0x80) ? kPoly : 0); }
+
+uint8_t Mul(uint8_t a, uint8_t b) {
+  uint8_t ret = 0;
+  while (b) {
+    if (b & 1) ret ^= a;
+    a = Xtime(a);
+    b >>= 1;
+  }
+  return ret;
+}
+
+// a^254 is the inverse of a, a must not be 0.
+uint8_t Inverse(uint8_t a) {
+  uint8_t ret = 1;
+  for (int i = 0; i < 7; i++) {
+    a = Mul(a, a);
+    ret = Mul(ret, a);
+  }
+  return ret;
+}
+
+// alpha^n.
+uint8_t Pow(size_t n) {
+  uint8_t ret = 1;
+  for (size_t i = 0; i < n; i++) ret = Xtime(ret);
+  return ret;
+}
+
+// Generator (x + 1)(x + alpha) = x^2 + kGen1 x + kGen0.
+constexpr uint8_t kGen1 = 3;
+constexpr uint8_t kGen0 = 2;
+
+}  // namespace
+
+void FecEncode(const uint8_t *data, size_t len, uint8_t *parity) {
+  // Remainder of data(x) * x^2 divided by the generator.
+  uint8_t r1 = 0;
+  uint8_t r0 = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t feedback = data[i] ^ r1;
+    r1 = r0 ^ Mul(feedback, kGen1);
+    r0 = Mul(feedback, kGen0);
+  }
+  parity[0] = r1;
+  parity[1] = r0;
+}
+
+bool FecCorrect(uint8_t *data, size_t len, const uint8_t *erased,
+                size_t erased_count) {
+  // data[i] is the coefficient of x^(len - 1 - i), syndromes are the
+  // codeword at 1 and alpha.
+  uint8_t s0 = 0;
+  uint8_t s1 = 0;
+  for (size_t i = 0; i < len; i++) {
+    s0 ^= data[i];
+    s1 = Xtime(s1) ^ data[i];
+  }
+  if (s0 == 0 && s1 == 0) return true;
+
+  if (erased_count == 0) {
+    // One error of value s0 at i, with s1 = s0 * alpha^(len - 1 - i).
+    if (s0 == 0) return false;
+    uint8_t x = s0;
+    for (size_t k = 0; k < len; k++, x = Xtime(x)) {
+      if (x == s1) {
+        data[len - 1 - k] ^= s0;
+        return true;
+      }
+    }
+    return false;
+  }
+  if (erased_count == 1) {
+    // The erasure is all of it, or there's another error we can't fix.
+    size_t i = erased[0];
+    if (Mul(s0, Pow(len - 1 - i)) != s1) return false;
+    data[i] ^= s0;
+    return true;
+  }
+  if (erased_count == 2) {
+    // e0 + e1 = s0, e0 x0 + e1 x1 = s1.
+    size_t i0 = erased[0];
+    size_t i1 = erased[1];
+    uint8_t x0 = Pow(len - 1 - i0);
+    uint8_t x1 = Pow(len - 1 - i1);
+    uint8_t e1 = Mul(s1 ^ Mul(s0, x0), Inverse(x0 ^ x1));
+    data[i0] ^= s0 ^ e1;
+    data[i1] ^= e1;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace ir
+}  // namespace hitcon
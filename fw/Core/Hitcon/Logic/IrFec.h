@@ -0,0 +1,33 @@
+#ifndef HITCON_LOGIC_IR_FEC_H_
+#define HITCON_LOGIC_IR_FEC_H_
+
+#include <Service/IrParam.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+/*
+Forward error correction for IR packets, a Reed-Solomon code over GF(2^8)
+with IR_FEC_PARITY_BYTES of parity after the data. It fixes either one wrong
+byte anywhere, or up to two erased bytes whose positions are known. IrDecoder
+knows a byte is erased when one of its bits had an invalid sample count.
+
+Only shifts and XOR, no tables, so it costs no flash beyond the code.
+*/
+
+// Parity of data[0, len) into parity[0, IR_FEC_PARITY_BYTES).
+void FecEncode(const uint8_t *data, size_t len, uint8_t *parity);
+
+// Corrects data[0, len), the data followed by its parity, in place. erased
+// holds erased_count indices into data. Returns false if it can't be
+// corrected.
+bool FecCorrect(uint8_t *data, size_t len, const uint8_t *erased,
+                size_t erased_count);
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_FEC_H_
@@ -0,0 +1,327 @@
+#ifndef HITCON_LOGIC_IR_FRAGMENT_H_
+#define HITCON_LOGIC_IR_FRAGMENT_H_
+
+#include <Service/IrParam.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hitcon {
+
+namespace ir {
+
+constexpr size_t FRAGMENT_SENDER_LEN = 2;
+constexpr size_t FRAGMENT_HEADER_SIZE = FRAGMENT_SENDER_LEN + 2;
+// IrDecoder delivers at most MAX_PACKET_PAYLOAD_BYTES - 3 bytes, the size byte
+// and the checksum fit below MAX_PACKET_PAYLOAD_BYTES. 2 of them are the IrData
+// header, IR_DATA_HEADER_SIZE in IrController.h.
+constexpr size_t FRAGMENT_DATA_SIZE =
+    MAX_PACKET_PAYLOAD_BYTES - 3 - 2 - FRAGMENT_HEADER_SIZE;
+constexpr size_t FRAGMENT_MAX_COUNT = 6;
+constexpr size_t FRAGMENT_MAX_MESSAGE = FRAGMENT_MAX_COUNT * FRAGMENT_DATA_SIZE;
+// Messages being reassembled at once, from different senders.
+constexpr size_t FRAGMENT_REASSEMBLY_SLOTS = 2;
+
+// Timeouts in Tick() calls, 1s each from IrController.
+// The sender sends the fragments not acknowledged again after this.
+constexpr uint8_t FRAGMENT_ACK_TICKS = 3;
+// Rounds of the above before the sender gives up.
+constexpr uint8_t FRAGMENT_RETRIES = 3;
+// The receiver acknowledges what it has after this without a fragment, in
+// case the one asking for it was lost.
+constexpr uint8_t FRAGMENT_GAP_TICKS = 2;
+// And frees the slot after this, done or not.
+constexpr uint8_t FRAGMENT_TIMEOUT_TICKS = 10;
+
+constexpr uint8_t kFragmentIndexMask = 0x07;
+constexpr uint8_t kFragmentLastShift = 3;
+constexpr uint8_t kFragmentAckRequest = 0x80;
+static_assert(FRAGMENT_MAX_COUNT <= kFragmentIndexMask + 1);
+
+// One piece of a message, the opaq of an IrData.
+struct FragmentPacket {
+  // Picked by the sender at random, with msg_id tells messages apart.
+  uint8_t sender[FRAGMENT_SENDER_LEN];
+  uint8_t msg_id;
+  uint8_t index;
+  // 0x07 - Index of this fragment.
+  // 0x38 - Index of the last fragment.
+  // 0x80 - Last fragment of this round, acknowledge what you have.
+  uint8_t data[FRAGMENT_DATA_SIZE];
+  // Every fragment but the last is full.
+};
+
+// Which fragments of a message the receiver has, the opaq of an IrData.
+struct FragmentAckPacket {
+  uint8_t sender[FRAGMENT_SENDER_LEN];
+  uint8_t msg_id;
+  // Bit i is set if fragment i has been received.
+  uint8_t received;
+};
+
+/*
+Carries messages of up to FRAGMENT_MAX_MESSAGE bytes in FragmentPacket, each
+of which fits in one IR packet, so a bit error or a collision costs one
+fragment instead of the whole message.
+
+Selective repeat: the sender sends every fragment not yet acknowledged, the
+last of the round asking for a FragmentAckPacket, and then sends again what
+the acknowledgement says is missing. If none comes back in
+FRAGMENT_ACK_TICKS, the whole round is sent again. The receiver reassembles
+by sender and msg_id, and keeps the slot after the message is done so a
+round sent again because the acknowledgement was lost is acknowledged again,
+not delivered twice.
+
+One message is sent at a time, and none before Init() gives us a sender ID.
+
+Port connects it to IrController, and lets the tests run it on the host:
+- bool Port::CanSend(): the transmitter takes another packet.
+- bool Port::SendFragment(const FragmentPacket &packet, size_t len): len is
+  the header and the data, false if busy. Port should call Pump() once it's
+  on the air, for the next one.
+- bool Port::SendFragmentAck(const FragmentAckPacket &ack).
+- void Port::OnMessage(const uint8_t *data, size_t len): a message from
+  someone is complete.
+- void Port::OnMessageSent(bool acked): our message was acknowledged, or the
+  retries ran out.
+*/
+template <class Port>
+class Fragmenter {
+ public:
+  explicit Fragmenter(Port *port)
+      : port(port), has_sender(false), tx_msg_id(0), tx_len(0), tx_count(0),
+        tx_to_send(0), tx_acked(0), tx_wait(0), tx_retries(0) {
+    memset(tx_sender, 0, sizeof(tx_sender));
+    memset(slots, 0, sizeof(slots));
+  }
+
+  // Our sender ID and the first msg_id, both random.
+  void Init(const uint8_t *sender, uint8_t msg_id) {
+    memcpy(tx_sender, sender, FRAGMENT_SENDER_LEN);
+    tx_msg_id = msg_id;
+    has_sender = true;
+  }
+
+  bool HasSender() { return has_sender; }
+
+  // Returns false if a message is still being sent, it's too long, or there
+  // is no sender ID yet.
+  bool Send(const uint8_t *data, size_t len);
+
+  // A message is being sent.
+  bool Busy() { return tx_count != 0; }
+
+  // Sends what fits in the transmitter.
+  void Pump();
+
+  // len is the header and the data.
+  void OnFragment(const FragmentPacket &packet, size_t len);
+
+  void OnFragmentAck(const FragmentAckPacket &ack);
+
+  // Every 1s, for the timeouts.
+  void Tick();
+
+ private:
+  struct Slot {
+    // FRAGMENT_TIMEOUT_TICKS while in use, counts down without fragments.
+    uint8_t ttl;
+    // Ticks since the last fragment.
+    uint8_t idle;
+    uint8_t sender[FRAGMENT_SENDER_LEN];
+    uint8_t msg_id;
+    uint8_t last;
+    uint8_t received;
+    bool done;
+    // Bytes in the last fragment, 0 until it's here.
+    uint8_t last_len;
+    uint8_t data[FRAGMENT_MAX_MESSAGE];
+  };
+
+  Port *port;
+
+  bool has_sender;
+
+  // The message we send.
+  uint8_t tx_sender[FRAGMENT_SENDER_LEN];
+  uint8_t tx_msg_id;
+  uint8_t tx_data[FRAGMENT_MAX_MESSAGE];
+  uint8_t tx_len;
+  // Fragments, 0 if nothing is being sent.
+  uint8_t tx_count;
+  // Fragments left to hand to the Port in this round.
+  uint8_t tx_to_send;
+  uint8_t tx_acked;
+  // Ticks left until the round is over without an acknowledgement.
+  uint8_t tx_wait;
+  uint8_t tx_retries;
+
+  Slot slots[FRAGMENT_REASSEMBLY_SLOTS];
+
+  uint8_t AllFragments() { return (1 << tx_count) - 1; }
+
+  void SendAck(const Slot &slot) {
+    FragmentAckPacket ack;
+    memcpy(ack.sender, slot.sender, FRAGMENT_SENDER_LEN);
+    ack.msg_id = slot.msg_id;
+    ack.received = slot.received;
+    port->SendFragmentAck(ack);
+  }
+
+  // Next round of everything not acknowledged, or give up.
+  void Resend();
+
+  void Finish(bool acked) {
+    tx_count = 0;
+    tx_to_send = 0;
+    tx_msg_id++;
+    port->OnMessageSent(acked);
+  }
+};
+
+template <class Port>
+bool Fragmenter<Port>::Send(const uint8_t *data, size_t len) {
+  if (!has_sender || Busy() || len == 0 || len > FRAGMENT_MAX_MESSAGE) {
+    return false;
+  }
+  memcpy(tx_data, data, len);
+  tx_len = len;
+  tx_count = (len + FRAGMENT_DATA_SIZE - 1) / FRAGMENT_DATA_SIZE;
+  tx_acked = 0;
+  tx_to_send = AllFragments();
+  tx_retries = FRAGMENT_RETRIES;
+  tx_wait = FRAGMENT_ACK_TICKS;
+  Pump();
+  return true;
+}
+
+template <class Port>
+void Fragmenter<Port>::Pump() {
+  while (tx_to_send && port->CanSend()) {
+    uint8_t i = __builtin_ctz(tx_to_send);
+    uint8_t rest = tx_to_send & ~(1 << i);
+    FragmentPacket packet;
+    memcpy(packet.sender, tx_sender, FRAGMENT_SENDER_LEN);
+    packet.msg_id = tx_msg_id;
+    packet.index = i | ((tx_count - 1) << kFragmentLastShift) |
+                   (rest ? 0 : kFragmentAckRequest);
+    size_t offset = i * FRAGMENT_DATA_SIZE;
+    size_t len = tx_len - offset;
+    if (len > FRAGMENT_DATA_SIZE) len = FRAGMENT_DATA_SIZE;
+    memcpy(packet.data, &tx_data[offset], len);
+    if (!port->SendFragment(packet, FRAGMENT_HEADER_SIZE + len)) return;
+    tx_to_send = rest;
+    // The round's timer starts with its last fragment.
+    tx_wait = FRAGMENT_ACK_TICKS;
+  }
+}
+
+template <class Port>
+void Fragmenter<Port>::Resend() {
+  if (tx_retries == 0) {
+    Finish(false);
+    return;
+  }
+  tx_retries--;
+  tx_to_send = AllFragments() & ~tx_acked;
+  tx_wait = FRAGMENT_ACK_TICKS;
+  Pump();
+}
+
+template <class Port>
+void Fragmenter<Port>::OnFragment(const FragmentPacket &packet, size_t len) {
+  // Too short, or our own heard back.
+  if (len <= FRAGMENT_HEADER_SIZE ||
+      (has_sender &&
+       memcmp(packet.sender, tx_sender, FRAGMENT_SENDER_LEN) == 0)) {
+    return;
+  }
+  size_t data_len = len - FRAGMENT_HEADER_SIZE;
+  uint8_t index = packet.index & kFragmentIndexMask;
+  uint8_t last = (packet.index >> kFragmentLastShift) & kFragmentIndexMask;
+  if (last >= FRAGMENT_MAX_COUNT || index > last ||
+      data_len > FRAGMENT_DATA_SIZE ||
+      (index < last && data_len != FRAGMENT_DATA_SIZE)) {
+    return;
+  }
+
+  Slot *slot = nullptr;
+  Slot *victim = &slots[0];
+  for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS; i++) {
+    Slot &s = slots[i];
+    if (s.ttl && s.msg_id == packet.msg_id &&
+        memcmp(s.sender, packet.sender, FRAGMENT_SENDER_LEN) == 0) {
+      slot = &s;
+      break;
+    }
+    // A free slot, or else the one closest to timing out.
+    if (s.ttl < victim->ttl) victim = &s;
+  }
+  if (!slot) {
+    slot = victim;
+    slot->idle = 0;
+    memcpy(slot->sender, packet.sender, FRAGMENT_SENDER_LEN);
+    slot->msg_id = packet.msg_id;
+    slot->last = last;
+    slot->received = 0;
+    slot->done = false;
+    slot->last_len = 0;
+  }
+  if (last != slot->last) return;
+  slot->ttl = FRAGMENT_TIMEOUT_TICKS;
+  slot->idle = 0;
+
+  if (!slot->done) {
+    memcpy(&slot->data[index * FRAGMENT_DATA_SIZE], packet.data, data_len);
+    slot->received |= 1 << index;
+    if (index == last) slot->last_len = data_len;
+    if (slot->received == (1 << (last + 1)) - 1) {
+      slot->done = true;
+      port->OnMessage(slot->data, last * FRAGMENT_DATA_SIZE + slot->last_len);
+      SendAck(*slot);
+      return;
+    }
+  }
+  if (packet.index & kFragmentAckRequest) SendAck(*slot);
+}
+
+template <class Port>
+void Fragmenter<Port>::OnFragmentAck(const FragmentAckPacket &ack) {
+  if (!Busy() || ack.msg_id != tx_msg_id ||
+      memcmp(ack.sender, tx_sender, FRAGMENT_SENDER_LEN) != 0) {
+    return;
+  }
+  tx_acked |= ack.received & AllFragments();
+  tx_to_send &= ~tx_acked;
+  if (tx_acked == AllFragments()) {
+    Finish(true);
+  } else if (tx_to_send == 0) {
+    // The round is over, send what's missing.
+    Resend();
+  }
+}
+
+template <class Port>
+void Fragmenter<Port>::Tick() {
+  if (Busy()) {
+    if (tx_to_send) {
+      // Still waiting for the transmitter.
+      Pump();
+    } else if (tx_wait == 0 || --tx_wait == 0) {
+      Resend();
+    }
+  }
+
+  for (size_t i = 0; i < FRAGMENT_REASSEMBLY_SLOTS; i++) {
+    Slot &slot = slots[i];
+    if (!slot.ttl) continue;
+    slot.ttl--;
+    slot.idle++;
+    if (!slot.done && slot.idle == FRAGMENT_GAP_TICKS) SendAck(slot);
+  }
+}
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_FRAGMENT_H_
@@ -1,6 +1,8 @@
 #ifndef HITCON_LOGIC_IR_LOGIC_H_
 #define HITCON_LOGIC_IR_LOGIC_H_
 
+#include <Logic/IrDecoder.h>
+#include <Logic/IrTxQueue.h>
 #include <Service/IrParam.h>
 #include <Service/Sched/Scheduler.h>
 #include <Service/Sched/Task.h>
@@ -12,19 +14,6 @@ namespace hitcon {
 
 namespace ir {
 
-struct IrPacket {
-  // IR Packet
-  // | header | data (1 byte size + n bytes data + 1 byte checksum) |
-
-  IrPacket() : size_(0) {}
-
-  // We need to add 3 bytes because we need
-  // at least 1 byte to accomodate the size.
-  // at least 1 byte to accomodate the chksum.
-  uint8_t data_[MAX_PACKET_PAYLOAD_BYTES + 4];
-  size_t size_;
-};
-
 class IrLogic {
  public:
   IrLogic();
@@ -32,52 +21,66 @@ class IrLogic {
   // For any actions that needs to be done during init.
   void Init();
 
-  // Every time IR_SERVICE_RX_SIZE byte of buffer is received, this will be
-  // called.
-  void OnBufferReceived(uint8_t *buffer);
+  // Samples forwarded by the base station over xboard.
+  void OnXBoardPacket(void *arg);
 
   // Upper layer should call ths function so whenever a well formed packet
   // is received the callback will be called.
   void SetOnPacketReceived(callback_t callback, void *callback_arg1);
 
-  // Send packet with data and size len.
-  bool SendPacket(uint8_t *data, size_t len);
-  // Return true if it's possible for us to send directly.
+  // Queue packet with data and size len, it goes out as soon as the channel
+  // allows, kHigh ones first, on TxPhy(). done(done_arg, nullptr) is called
+  // from a task once it's on the air. Returns false if the queue is full.
+  bool SendPacket(uint8_t *data, size_t len,
+                  TxPriority priority = TxPriority::kNormal,
+                  callback_t done = nullptr, void *done_arg = nullptr);
+  // Return true if SendPacket() would take a packet now.
   bool AvailableToSend();
 
+  // IrPhy for the next packet: IR_TX_PHY, or the one the last packet came in
+  // on if that was IrPhy::kFast within IR_PHY_FAST_HOLD_MS.
+  IrPhy TxPhy();
+
   void EncodePacket(uint8_t *data, size_t len, IrPacket &packet);
-  // Enqueue the task and reset the counter
-  void OnBufferReceivedEnqueueTask(uint8_t *buffer);
 
   // % of time in last 30 second whereby there's a transmission.
   // 100 => 100%
   // 0 => 0%
   int GetLoadFactor();
 
+  // Called by decoder, from the IrService RX DMA task for IR.
+  void OnPacketDecoded(IrPacket *packet);
+
+  // Calls callback with rx_packet_ctrler.
+  void DeliverPacket(void *unused);
+
+  // Feed samples to decoder and hold off suspend while a packet is coming in.
+  void Decode(const uint8_t *buffer, size_t len);
+
+  // Called by IrService from the TX DMA task, starts the next packet.
+  void OnTxDone(void *unused);
+
+  // Calls the done callbacks of sent packets.
+  void DeliverTxDone(void *unused);
+
   // TODO: check if we need >1 callbacks
   // OnPacketReceived callback
   callback_t callback;
   void *callback_arg;
-  IrPacket rx_packet;
+  IrDecoder decoder;
   // double buffering to avoid RW same time
   IrPacket rx_packet_ctrler;
-  IrPacket tx_packet;
+  // Runs DeliverPacket() so the upper layer doesn't run in the RX DMA task.
+  service::sched::Task deliver_task;
+  IrTxQueue tx_queue;
+  // Runs DeliverTxDone() so the upper layer doesn't run in the TX DMA task.
+  service::sched::Task tx_done_task;
+  // IrPhy of the last packet decoded, and SysTimer::GetTime() then.
+  IrPhy rx_phy;
+  unsigned rx_phy_time;
 
   // This variable is a mystery.
   size_t dummy1 = 0xBAADF00D;
-
-  // Total periods collected for load factor computation.
-  size_t lf_total_period;
-  // Total periods of non-zero (transmission) collected for load factor
-  // computation.
-  size_t lf_nonzero_period;
-
-  // Load factor after low pass filter.
-  // In Q15.16 fixed point.
-  uint32_t lowpass_loadfactor;
-
-  // To split OnBufferReceived into pieces
-  size_t buffer_received_ctr;
 };
 
 extern IrLogic irLogic;
@@ -0,0 +1,159 @@
+#include <Logic/IrMac.h>
+#include <Logic/IrStats.h>
+
+namespace hitcon {
+namespace ir {
+
+namespace {
+
+// since_release stops counting here.
+constexpr size_t kSinceReleaseMax = 100000;
+
+// Quiet bytes before a release, at least kQuietMin plus up to the window.
+constexpr size_t kQuietMin = 20;
+// Routine runs after a collision, at least kCollisionMin plus up to the
+// window.
+constexpr uint16_t kCollisionMin = 8;
+// Contention window at backoff 0, for both of the above.
+constexpr uint32_t kWindowMin = 8;
+constexpr uint8_t kBackoffMax = 5;
+// Load factor per step of the backoff floor.
+constexpr int kLoadPerBackoff = 20;
+// Frames sent back to back on one release.
+constexpr uint8_t kBurstMax = 4;
+
+// collision_wait before the routine picks it.
+constexpr uint16_t kCollisionUndrawn = 0xFFFF;
+
+}  // namespace
+
+IrMac::IrMac()
+    : state(kIdle), collision_wait(0), quiet_cnt(0),
+      required_quiet_period(500), since_release(kSinceReleaseMax), backoff(0),
+      since_request(0), burst(0), held(false),
+      lf_period_bits(0), lf_period_bytes(0), lf_total_period(0),
+      lf_nonzero_period(0), lowpass_loadfactor(0) {}
+
+void IrMac::Request() {
+  held = false;
+  if (state == kIdle) {
+    state = kWaitQuiet;
+    since_request = 0;
+  }
+}
+
+void IrMac::Done() {
+  state = kIdle;
+  held = true;
+  burst++;
+  if (backoff > BackoffFloor()) backoff--;
+}
+
+bool IrMac::Chain() {
+  if (state != kIdle || !held || burst >= kBurstMax) return false;
+  held = false;
+  state = kSending;
+  return true;
+}
+
+void IrMac::OnRxByte(uint8_t byte) {
+  held = false;
+  if (byte)
+    quiet_cnt = 0;
+  else
+    quiet_cnt++;
+
+  // Our own header starts with silence, samples [52, 60) after the release are
+  // before it.
+  if ((since_release == 6 && (byte & 0xF0)) ||
+      (since_release == 7 && (byte & 0x0F))) {
+    // Abort transmission.
+    g_ir_stats.tx_collisions++;
+    state = kCollision;
+    collision_wait = kCollisionUndrawn;
+    if (backoff < kBackoffMax) backoff++;
+  }
+  since_release++;
+  since_request++;
+
+  lf_period_bits |= byte;
+  if (++lf_period_bytes >= IR_LOADFACTOR_PERIOD) UpdateLoadFactor(0, 0);
+}
+
+void IrMac::OnRxSilence(size_t bytes) {
+  held = false;
+  quiet_cnt += bytes;
+  since_release += bytes;
+  since_request += bytes;
+  UpdateLoadFactor(0, bytes);
+}
+
+bool IrMac::TryRelease() {
+  if (state != kWaitQuiet || quiet_cnt <= required_quiet_period) return false;
+  state = kSending;
+  since_release = 0;
+  burst = 0;
+  g_ir_stats.mac_releases++;
+  g_ir_stats.mac_wait_bytes += since_request;
+  if (since_request > g_ir_stats.mac_wait_max) {
+    g_ir_stats.mac_wait_max = since_request;
+  }
+  return true;
+}
+
+void IrMac::Routine(uint32_t random) {
+  uint8_t floor = BackoffFloor();
+  if (backoff < floor) backoff = floor;
+  uint32_t window = kWindowMin << backoff;
+  required_quiet_period = kQuietMin + random % window;
+  if (since_release >= kSinceReleaseMax) since_release = kSinceReleaseMax;
+
+  if (state == kCollision) {
+    // Collision, let's wait randomly.
+    if (collision_wait == kCollisionUndrawn) {
+      collision_wait = kCollisionMin + (random >> 16) % window;
+    } else if (collision_wait == 0) {
+      // Wait's over, retransmit.
+      state = kWaitQuiet;
+    } else {
+      collision_wait--;
+    }
+  }
+}
+
+void IrMac::UpdateLoadFactor(uint8_t bits, size_t bytes) {
+  lf_period_bits |= bits;
+  lf_period_bytes += bytes;
+  while (lf_period_bytes >= IR_LOADFACTOR_PERIOD) {
+    if (lf_period_bits) {
+      lf_nonzero_period++;
+    }
+    lf_total_period++;
+    lf_period_bits = 0;
+    lf_period_bytes -= IR_LOADFACTOR_PERIOD;
+    if (lf_total_period >= IR_LOADFACTOR_SAMPLING_COUNT) {
+      // current_lf is in Q15.16 fixed point.
+      uint32_t current_lf = (lf_nonzero_period << 16) / lf_total_period;
+      // Apply a low pass filter.
+      lowpass_loadfactor =
+          ((LF_ALPHA_COMPL * lowpass_loadfactor) + (LF_ALPHA * current_lf)) >>
+          10;
+      // Reset the counters.
+      lf_nonzero_period = 0;
+      lf_total_period = 0;
+    }
+  }
+}
+
+int IrMac::LoadFactor() {
+  int ret = lowpass_loadfactor;
+  ret = ret * 100 * LF_MAX_SCALE;
+  ret = ret >> 16;
+  if (ret > 100) ret = 100;
+  return ret;
+}
+
+uint8_t IrMac::BackoffFloor() { return LoadFactor() / kLoadPerBackoff; }
+
+}  // namespace ir
+}  // namespace hitcon
@@ -0,0 +1,128 @@
+#ifndef HITCON_LOGIC_IR_MAC_H_
+#define HITCON_LOGIC_IR_MAC_H_
+
+#include <Service/IrParam.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+/*
+Decides when IrService may put a frame on the air, listen before talk:
+- A frame waits until RX has been quiet for 20 bytes plus a random part of
+  the contention window.
+- Once released, anything heard in samples [52, 60) after the release is
+  someone else who released at about the same time, before our own frame
+  starts. The frame is dropped and waits 8 routine runs plus a random part of
+  the contention window before it tries again.
+- The window is 8 << backoff. backoff goes up by one on every collision
+  and down by one on every frame sent, and never below what the load factor
+  asks for, so a busy room spreads out before it starts colliding.
+- A frame ready as the last one is done follows it on the same channel
+  access, without waiting for quiet, up to kBurstMax frames in a row. The
+  others are still waiting for quiet and hear no gap long enough.
+
+Fed with every RX byte, the same bytes IrDecoder gets, and the 22ms routine.
+Has no hardware dependency so the IR channel simulator runs the same code.
+*/
+class IrMac {
+ public:
+  IrMac();
+
+  // Nothing to send, a new frame can be requested.
+  bool Idle() { return state == kIdle; }
+
+  // Released and not collided, the frame should be going out.
+  bool Sending() { return state == kSending; }
+
+  // A frame is ready, wait for the channel.
+  void Request();
+
+  // The frame is out, back to idle.
+  void Done();
+
+  // Right after Done(), send the next frame on the channel we still hold.
+  // Returns false if there's no such channel or the burst is used up, then
+  // Request() as usual.
+  bool Chain();
+
+  // One RX byte of 8 samples.
+  void OnRxByte(uint8_t byte);
+
+  // bytes all zero RX bytes.
+  void OnRxSilence(size_t bytes);
+
+  // Call where a frame may start, after each RX run. Returns true if the
+  // channel was just released to the waiting frame, it starts from the top.
+  bool TryRelease();
+
+  // Every IR_MAC_ROUTINE_PERIOD ms, random is from g_fast_random_pool.
+  void Routine(uint32_t random);
+
+  // Share of recent time with a transmission on the air, 0 to 100, see
+  // LF_MAX_SCALE.
+  int LoadFactor();
+
+ private:
+  enum State : uint8_t {
+    kIdle,
+    // Waiting for air space to silent.
+    kWaitQuiet,
+    // Waiting for collision to finish.
+    kCollision,
+    kSending,
+  };
+  State state;
+
+  // Routine runs left before retrying after a collision, kCollisionUndrawn
+  // until the next routine picks it.
+  uint16_t collision_wait;
+
+  // How long has rx been quiet, in RX bytes.
+  size_t quiet_cnt;
+
+  // How long should we wait until we transmit, in RX bytes.
+  size_t required_quiet_period;
+
+  // How many RX bytes since the tx is released?
+  size_t since_release;
+
+  // Contention window exponent, see above.
+  uint8_t backoff;
+
+  // RX bytes since Request() left kIdle, for IrStats.
+  uint32_t since_request;
+
+  // Frames sent since the release.
+  uint8_t burst;
+  // Done() and nothing heard or requested since, Chain() may go.
+  bool held;
+
+  // Account bytes RX bytes for the load factor, bits is the OR of them.
+  void UpdateLoadFactor(uint8_t bits, size_t bytes);
+
+  // Lowest backoff for the current load factor.
+  uint8_t BackoffFloor();
+
+  // OR of the RX bytes in the current IR_LOADFACTOR_PERIOD.
+  uint8_t lf_period_bits;
+  // RX bytes so far in the current IR_LOADFACTOR_PERIOD.
+  size_t lf_period_bytes;
+
+  // Total periods collected for load factor computation.
+  size_t lf_total_period;
+  // Total periods of non-zero (transmission) collected for load factor
+  // computation.
+  size_t lf_nonzero_period;
+
+  // Load factor after low pass filter.
+  // In Q15.16 fixed point.
+  uint32_t lowpass_loadfactor;
+};
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_MAC_H_
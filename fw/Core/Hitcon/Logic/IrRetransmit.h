@@ -0,0 +1,319 @@
+#ifndef HITCON_LOGIC_IR_RETRANSMIT_H_
+#define HITCON_LOGIC_IR_RETRANSMIT_H_
+
+#include <Logic/IrStats.h>
+#include <Service/IrParam.h>
+#include <Service/Sched/Checks.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hitcon {
+
+namespace ir {
+
+constexpr size_t PACKET_HASH_LEN = 6;
+// An aggregated acknowledgement carries up to MULTI_ACK_MAX hashes cut to
+// MULTI_ACK_HASH_LEN bytes. With the IrData header and the count that is 27
+// bytes, IrDecoder delivers up to MAX_PACKET_PAYLOAD_BYTES - 3.
+constexpr size_t MULTI_ACK_HASH_LEN = 4;
+constexpr size_t MULTI_ACK_MAX = 6;
+
+constexpr size_t RETX_QUEUE_SIZE = 16;
+// Maintain() calls before a packet not acknowledged is sent again, give or
+// take RETX_RETRY_JITTER.
+constexpr uint16_t RETX_RETRY_TICKS = 600;
+constexpr uint16_t RETX_RETRY_JITTER = 200;
+
+constexpr uint8_t kRetransmitLimitMask = 0x07;
+constexpr uint8_t kRetransmitStatusMask = 0xe0;
+constexpr uint8_t kRetransmitStatusSlotUnused = 0x00;
+constexpr uint8_t kRetransmitStatusWaitHashAvail = 0x20;
+constexpr uint8_t kRetransmitStatusWaitHashDone = 0x40;
+constexpr uint8_t kRetransmitStatusWaitTxSlot = 0x80;
+constexpr uint8_t kRetransmitStatusWaitAck = 0xA0;
+
+// End of a slot list.
+constexpr uint8_t kRetransmitNone = 0xff;
+static_assert(RETX_QUEUE_SIZE < kRetransmitNone);
+
+enum class AckTag : uint8_t {
+  ACK_TAG_NONE = 0,
+  ACK_TAG_PUBKEY_RECOG = 1,
+};
+
+struct RetransmittableIrPacket {
+  uint8_t status;
+  // 0x07 - retransmit limit left.
+  // 0xe0 - Status
+  //   - 0x00 Slot is unused.
+  //   - 0x20 Waiting for hashing processor to be available.
+  //   - 0x40 Waiting for hashing processor to finish.
+  //   - 0x80 Waiting for IrController's tx slot to open up.
+  //   - 0xA0 Waiting for Ack.
+  AckTag ack_tag;
+  // Ack tag is used internally to denote special events.
+  uint16_t retry_at;
+  // Maintain() tick to send it again at, while waiting for Ack.
+  uint8_t prev;
+  uint8_t next;
+  // Neighbours in the list of the status, kRetransmitNone at the ends.
+  uint8_t size;
+  uint8_t data[MAX_PACKET_PAYLOAD_BYTES + 4];
+  uint8_t hash[PACKET_HASH_LEN];
+};
+
+/*
+The retransmit slots behind IrController::SendPacketWithRetransmit(). Each
+packet is hashed, sent, and sent again every 400-800 Maintain() calls until an
+acknowledgement carrying its hash comes back or it runs out of retries.
+
+Nothing waits for Maintain() but the retries. A packet is hashed as soon as the
+hash service is free, and sent as soon as its hash is back and the
+transmitter has room. Every status but the one being hashed is a list of
+slots: the free ones, FIFOs of those waiting for the hash service and for the
+transmitter, and the ones waiting for an ack sorted by retry_at, so each
+step only looks at the head of its list.
+
+Port connects it to the rest of the badge, and lets the IR channel simulator
+run the same code on the host:
+- bool Port::StartHash(const uint8_t *data, size_t len): false if the hash
+  service is busy, otherwise the digest comes back through OnHashResult()
+  after it returns. Port should call Pump() once the service takes another.
+- bool Port::CanSend(): the transmitter takes another packet.
+- bool Port::Send(uint8_t *data, size_t len): false if busy. Port should
+  call Pump() once it's on the air, for the next one.
+- void Port::OnAcknowledgeTag(AckTag tag): a packet with tag was acknowledged.
+- uint32_t Port::Random().
+*/
+template <class Port>
+class RetransmitQueue {
+ public:
+  explicit RetransmitQueue(Port *port)
+      : port(port), current_hashing_slot(-1), now(0) {
+    memset(queued_packets_, 0, sizeof(queued_packets_));
+    for (size_t i = 0; i < RETX_QUEUE_SIZE; i++) Append(free_list, i);
+  }
+
+  // Returns false if every slot is in use.
+  bool Push(const uint8_t *data, size_t len, uint8_t retries, AckTag ack_tag) {
+    service::sched::my_assert(len <= MAX_PACKET_PAYLOAD_BYTES);
+    service::sched::my_assert(retries < 8);  // Max retries fits in 3 bits
+    uint8_t i = free_list.head;
+    if (i == kRetransmitNone) {
+      // No empty slot found
+      g_ir_stats.retx_queue_full++;
+      return false;
+    }
+    Unlink(free_list, i);
+    memcpy(&(queued_packets_[i].data[0]), data, len);
+    queued_packets_[i].size = len;
+    // Set status to Waiting for hashing processor and store retry limit
+    queued_packets_[i].status =
+        kRetransmitStatusWaitHashAvail | (retries & kRetransmitLimitMask);
+    queued_packets_[i].ack_tag = ack_tag;
+    Append(hash_list, i);
+    Pump();
+    return true;
+  }
+
+  // Starts the next hash and sends what the transmitter takes.
+  void Pump();
+
+  // Every 1s from IrController, for the retries.
+  void Maintain();
+
+  // Digest of the packet passed to the last Port::StartHash().
+  void OnHashResult(const uint8_t *digest) {
+    service::sched::my_assert(current_hashing_slot >= 0);
+    service::sched::my_assert(static_cast<size_t>(current_hashing_slot) <
+                              RETX_QUEUE_SIZE);
+    memcpy(&(queued_packets_[current_hashing_slot].hash[0]), digest,
+           PACKET_HASH_LEN);
+    uint8_t status = queued_packets_[current_hashing_slot].status;
+    // Update status to Waiting for IrController's tx slot
+    status = (status & (~kRetransmitStatusMask)) | kRetransmitStatusWaitTxSlot;
+    queued_packets_[current_hashing_slot].status =
+        status;  // Update the struct member
+    Append(send_list, current_hashing_slot);
+    current_hashing_slot = -1;
+    Pump();
+  }
+
+  // Called when we received an acknowledgment packet.
+  void OnAcknowledge(const uint8_t *packet_hash) {
+    Acknowledge(packet_hash, 1, PACKET_HASH_LEN);
+  }
+
+  // Called when we received an aggregated acknowledgment packet, with count
+  // hashes of MULTI_ACK_HASH_LEN bytes back to back.
+  void OnAcknowledgeMulti(const uint8_t *hashes, size_t count) {
+    Acknowledge(hashes, count, MULTI_ACK_HASH_LEN);
+  }
+
+ private:
+  struct List {
+    uint8_t head = kRetransmitNone;
+    uint8_t tail = kRetransmitNone;
+  };
+
+  Port *port;
+
+  RetransmittableIrPacket queued_packets_[RETX_QUEUE_SIZE];
+  int current_hashing_slot;
+  // Maintain() calls so far, wraps around.
+  uint16_t now;
+
+  List free_list;
+  // Waiting for the hash service, in the order pushed.
+  List hash_list;
+  // Waiting for the transmitter, in the order hashed or timed out.
+  List send_list;
+  // Waiting for an ack, by retry_at.
+  List ack_list;
+
+  void Append(List &list, uint8_t i) { InsertBefore(list, kRetransmitNone, i); }
+
+  // Puts slot i in list before slot at, at the tail for kRetransmitNone.
+  void InsertBefore(List &list, uint8_t at, uint8_t i) {
+    RetransmittableIrPacket &slot = queued_packets_[i];
+    slot.next = at;
+    slot.prev = at == kRetransmitNone ? list.tail : queued_packets_[at].prev;
+    if (slot.prev == kRetransmitNone) {
+      list.head = i;
+    } else {
+      queued_packets_[slot.prev].next = i;
+    }
+    if (at == kRetransmitNone) {
+      list.tail = i;
+    } else {
+      queued_packets_[at].prev = i;
+    }
+  }
+
+  void Unlink(List &list, uint8_t i) {
+    RetransmittableIrPacket &slot = queued_packets_[i];
+    if (slot.prev == kRetransmitNone) {
+      list.head = slot.next;
+    } else {
+      queued_packets_[slot.prev].next = slot.next;
+    }
+    if (slot.next == kRetransmitNone) {
+      list.tail = slot.prev;
+    } else {
+      queued_packets_[slot.next].prev = slot.prev;
+    }
+  }
+
+  // Hands the head of send_list to Port::Send(), false if busy.
+  bool TrySend();
+
+  // Clears every slot whose hash starts with one of the count hashes of len
+  // bytes, in one pass.
+  void Acknowledge(const uint8_t *hashes, size_t count, size_t len);
+};
+
+template <class Port>
+void RetransmitQueue<Port>::Acknowledge(const uint8_t *hashes, size_t count,
+                                        size_t len) {
+  for (size_t i = 0; i < RETX_QUEUE_SIZE; i++) {
+    uint8_t status = queued_packets_[i].status & kRetransmitStatusMask;
+    if (status != kRetransmitStatusWaitTxSlot &&
+        status != kRetransmitStatusWaitAck) {
+      continue;
+    }
+    for (size_t j = 0; j < count; j++) {
+      if (memcmp(queued_packets_[i].hash, &hashes[j * len], len) == 0) {
+        AckTag ack = queued_packets_[i].ack_tag;
+        g_ir_stats.retx_acked++;
+        port->OnAcknowledgeTag(ack);
+        // Received, no longer need to retransmit.
+        Unlink(status == kRetransmitStatusWaitAck ? ack_list : send_list, i);
+        queued_packets_[i].status =
+            (queued_packets_[i].status & (~kRetransmitStatusMask));
+        Append(free_list, i);
+        break;
+      }
+    }
+  }
+}
+
+template <class Port>
+bool RetransmitQueue<Port>::TrySend() {
+  uint8_t i = send_list.head;
+  RetransmittableIrPacket &slot = queued_packets_[i];
+  if (!port->Send(&(slot.data[0]), slot.size)) return false;
+  // Packet successfully queued for transmission. Update status to Waiting
+  // for ACK.
+  Unlink(send_list, i);
+  slot.status =
+      (slot.status & ~kRetransmitStatusMask) | kRetransmitStatusWaitAck;
+  // Set the timer for waiting for an acknowledgment packet.
+  slot.retry_at = now + RETX_RETRY_TICKS + RETX_RETRY_JITTER -
+                  (port->Random() % (2 * RETX_RETRY_JITTER));
+  // Timers are mostly pushed in order, so the walk from the tail is short.
+  uint8_t at = kRetransmitNone;
+  uint8_t before = ack_list.tail;
+  while (before != kRetransmitNone &&
+         static_cast<int16_t>(queued_packets_[before].retry_at -
+                              slot.retry_at) > 0) {
+    at = before;
+    before = queued_packets_[before].prev;
+  }
+  InsertBefore(ack_list, at, i);
+  return true;
+}
+
+template <class Port>
+void RetransmitQueue<Port>::Pump() {
+  uint8_t i = hash_list.head;
+  if (current_hashing_slot == -1 && i != kRetransmitNone) {
+    if (port->StartHash(&(queued_packets_[i].data[0]),
+                        queued_packets_[i].size)) {
+      Unlink(hash_list, i);
+      queued_packets_[i].status =
+          (queued_packets_[i].status & ~kRetransmitStatusMask) |
+          kRetransmitStatusWaitHashDone;
+      current_hashing_slot = i;
+    }
+    // If it's busy, Port calls Pump() again once it's free.
+  }
+  // Every one that fits goes, the transmitter queues them.
+  while (send_list.head != kRetransmitNone && port->CanSend()) {
+    if (!TrySend()) break;
+  }
+}
+
+template <class Port>
+void RetransmitQueue<Port>::Maintain() {
+  now++;
+  // Only the head of ack_list can be due first.
+  while (ack_list.head != kRetransmitNone &&
+         static_cast<int16_t>(now - queued_packets_[ack_list.head].retry_at) >=
+             0) {
+    uint8_t i = ack_list.head;
+    Unlink(ack_list, i);
+    // Timer elapsed, no ACK received. Check if retries are left.
+    uint8_t counts = queued_packets_[i].status & kRetransmitLimitMask;
+    if (counts == 0) {
+      // No more retries left. Mark this slot as unused.
+      g_ir_stats.retx_exhausted++;
+      queued_packets_[i].status = kRetransmitStatusSlotUnused;
+      Append(free_list, i);
+    } else {
+      // Retries left. Decrement the count and transition back to waiting for
+      // TX slot.
+      counts--;
+      g_ir_stats.retx_resent++;
+      queued_packets_[i].status = kRetransmitStatusWaitTxSlot | counts;
+      Append(send_list, i);
+    }
+  }
+  // Catches a Pump() the Port missed.
+  Pump();
+}
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_RETRANSMIT_H_
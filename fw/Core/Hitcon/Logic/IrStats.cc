@@ -0,0 +1,19 @@
+#include <Logic/IrStats.h>
+#include <string.h>
+
+namespace hitcon {
+namespace ir {
+
+IrStats g_ir_stats;
+
+const char *const IR_STATS_NAMES[IR_STATS_COUNT] = {
+    "TX",      "CHAIN",   "COLLIDE", "RELEASE", "WAIT",    "WAITMAX",
+    "HEADER",  "INV SZ",  "INV DAT", "INV FEC", "BAD SZ",  "FEC ERR",
+    "FEC FIX", "BAD CRC", "RX",      "RX OVR",  "TXQ FUL", "DUP",
+    "RTX FUL", "RTX ACK", "RTX RES", "RTX END",
+};
+
+void IrStatsReset() { memset(&g_ir_stats, 0, sizeof(g_ir_stats)); }
+
+}  // namespace ir
+}  // namespace hitcon
@@ -0,0 +1,77 @@
+#ifndef HITCON_LOGIC_IR_STATS_H_
+#define HITCON_LOGIC_IR_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+/*
+Counters of the IR stack, from the channel up, for tuning it with what the
+badges see in the field. Every field is a uint32_t that only goes up, so the
+hot paths pay one increment, and the block reads as IR_STATS_COUNT words in
+this order from DebugIrApp and UsbLogic. Add fields at the end, with a name
+in IR_STATS_NAMES and in STM32HID.py.
+*/
+struct IrStats {
+  // IrMac and IrService.
+  // Frames on the air, and of those chained behind the last one.
+  uint32_t tx_frames;
+  uint32_t tx_chained;
+  // Frames dropped on hearing someone else right after the release.
+  uint32_t tx_collisions;
+  // Releases, and RX bytes (8 samples each) from Request() to the release,
+  // summed and the longest.
+  uint32_t mac_releases;
+  uint32_t mac_wait_bytes;
+  uint32_t mac_wait_max;
+
+  // IrDecoder.
+  uint32_t rx_headers;
+  // Invalid bit in the size byte, in a plain packet, and past what FEC can
+  // fix.
+  uint32_t rx_invalid_size;
+  uint32_t rx_invalid_data;
+  uint32_t rx_invalid_fec;
+  // Size byte out of range.
+  uint32_t rx_bad_size;
+  uint32_t rx_fec_failed;
+  // FEC packets with erasures that were fixed.
+  uint32_t rx_fec_fixed;
+  uint32_t rx_bad_checksum;
+  uint32_t rx_packets;
+
+  // IrLogic.
+  // Decoded while the last one was still being delivered.
+  uint32_t rx_overrun;
+  uint32_t tx_queue_full;
+
+  // IrController and RetransmitQueue.
+  uint32_t rx_duplicates;
+  uint32_t retx_queue_full;
+  uint32_t retx_acked;
+  uint32_t retx_resent;
+  // Ran out of retries without an ACK.
+  uint32_t retx_exhausted;
+};
+
+constexpr size_t IR_STATS_COUNT = sizeof(IrStats) / sizeof(uint32_t);
+
+// Short names for the display, in field order.
+extern const char *const IR_STATS_NAMES[IR_STATS_COUNT];
+
+extern IrStats g_ir_stats;
+
+// Counter i in field order.
+inline uint32_t IrStatsGet(size_t i) {
+  return reinterpret_cast<const uint32_t *>(&g_ir_stats)[i];
+}
+
+void IrStatsReset();
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_STATS_H_
@@ -0,0 +1,72 @@
+#include <Logic/IrTxQueue.h>
+
+namespace hitcon {
+namespace ir {
+
+IrTxQueue::IrTxQueue() : next_seq(0), sending_slot(-1) {
+  for (size_t i = 0; i < TX_QUEUE_SIZE; i++) {
+    slots[i].state = kFree;
+  }
+}
+
+bool IrTxQueue::Push(const uint8_t *data, size_t len, TxPriority priority,
+                     bool fec, IrPhy phy, callback_t done,
+                     void *done_arg) {
+  for (size_t i = 0; i < TX_QUEUE_SIZE; i++) {
+    Slot &slot = slots[i];
+    if (slot.state != kFree) continue;
+    EncodePacket(data, len, slot.packet, fec);
+    slot.packet.phy_ = phy;
+    slot.state = kQueued;
+    slot.priority = priority;
+    slot.seq = next_seq++;
+    slot.done = done;
+    slot.done_arg = done_arg;
+    return true;
+  }
+  return false;
+}
+
+bool IrTxQueue::HasRoom() {
+  for (size_t i = 0; i < TX_QUEUE_SIZE; i++) {
+    if (slots[i].state == kFree) return true;
+  }
+  return false;
+}
+
+IrPacket *IrTxQueue::Pop() {
+  if (sending_slot != -1) return nullptr;
+  int best = -1;
+  for (size_t i = 0; i < TX_QUEUE_SIZE; i++) {
+    const Slot &slot = slots[i];
+    if (slot.state != kQueued) continue;
+    if (best == -1 || slot.priority > slots[best].priority ||
+        (slot.priority == slots[best].priority &&
+         static_cast<int8_t>(slot.seq - slots[best].seq) < 0)) {
+      best = i;
+    }
+  }
+  if (best == -1) return nullptr;
+  slots[best].state = kSending;
+  sending_slot = best;
+  return &slots[best].packet;
+}
+
+void IrTxQueue::OnSent() {
+  if (sending_slot == -1) return;
+  slots[sending_slot].state = kDone;
+  sending_slot = -1;
+}
+
+void IrTxQueue::DeliverDone() {
+  for (size_t i = 0; i < TX_QUEUE_SIZE; i++) {
+    Slot &slot = slots[i];
+    if (slot.state != kDone) continue;
+    // Free it first so the callback can queue another packet.
+    slot.state = kFree;
+    if (slot.done) slot.done(slot.done_arg, nullptr);
+  }
+}
+
+}  // namespace ir
+}  // namespace hitcon
@@ -0,0 +1,82 @@
+#ifndef HITCON_LOGIC_IR_TX_QUEUE_H_
+#define HITCON_LOGIC_IR_TX_QUEUE_H_
+
+#include <Logic/IrDecoder.h>
+#include <Service/IrParam.h>
+#include <Util/callback.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+
+namespace ir {
+
+constexpr size_t TX_QUEUE_SIZE = 4;
+
+enum class TxPriority : uint8_t {
+  kNormal = 0,
+  // Goes before every kNormal packet still in the queue.
+  kHigh = 1,
+};
+
+/*
+Encoded packets waiting for IrService, behind IrLogic::SendPacket(). Push()
+takes packets while another is on the air. Pop() hands out the highest
+priority first, oldest first among equals, and the packet stays in its slot
+until OnSent() since IrService reads it during the whole transmission.
+
+The done callback of a sent packet runs from DeliverDone(), so IrLogic can
+start the next frame from the TX DMA task and leave the callbacks to a task of
+their own.
+*/
+class IrTxQueue {
+ public:
+  IrTxQueue();
+
+  // Encodes data into a free slot, to go out on phy. done(done_arg, nullptr)
+  // is called once it's on the air, done may be nullptr. Returns false if
+  // every slot is in use.
+  bool Push(const uint8_t *data, size_t len, TxPriority priority, bool fec,
+            IrPhy phy, callback_t done, void *done_arg);
+
+  // A Push() would succeed.
+  bool HasRoom();
+
+  // The next packet to send, or nullptr if there's none or the last one
+  // popped isn't sent yet.
+  IrPacket *Pop();
+
+  // The packet from the last Pop() is out.
+  void OnSent();
+
+  // Calls the done callbacks of sent packets and frees their slots.
+  void DeliverDone();
+
+ private:
+  enum State : uint8_t {
+    kFree,
+    kQueued,
+    kSending,
+    kDone,
+  };
+
+  struct Slot {
+    State state;
+    TxPriority priority;
+    // Order of Push(), compared with wraparound.
+    uint8_t seq;
+    callback_t done;
+    void *done_arg;
+    IrPacket packet;
+  };
+
+  Slot slots[TX_QUEUE_SIZE];
+  uint8_t next_seq;
+  // Slot of the last Pop(), -1 if none is on the air.
+  int sending_slot;
+};
+
+}  // namespace ir
+}  // namespace hitcon
+
+#endif  // #ifndef HITCON_LOGIC_IR_TX_QUEUE_H_
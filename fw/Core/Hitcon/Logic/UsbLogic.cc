@@ -1,4 +1,5 @@
 #include <App/ShowNameApp.h>
+#include <Logic/IrStats.h>
 #include <Logic/NvStorage.h>
 #include <Logic/UsbLogic.h>
 #include <Logic/crc32.h>
@@ -130,6 +131,60 @@ void UsbLogic::OnDataRecv(void* arg) {
         }
       }
       break;
+    case USB_STATE_SCHED_STATS: {
+      // data[1] is the profiler slot and data[2] selects which 8 bytes of its
+      // TaskStats to send back. Unused slots read as zero. Slots from
+      // SCHED_OVERRUN_SLOT read the slice overrun log the same way, newest
+      // first, and SCHED_COUNT_SLOT reads the overrun and missed deadline
+      // counts. Slot 0xFF clears all stats instead.
+      keyboard_report = {0, 0, 0, 0, 0, 0, 0, 0};
+      size_t offset = data[2] * sizeof(keyboard_report);
+      uint8_t* src = nullptr;
+      size_t src_size = 0;
+      uint32_t counts[2];
+      if (data[1] == 0xFF) {
+        profiler.Reset();
+        slice_watchdog.Reset();
+      } else if (data[1] == SCHED_COUNT_SLOT) {
+        counts[0] = slice_watchdog.GetOverrunCount();
+        counts[1] = scheduler.GetMissedDeadlines();
+        src = reinterpret_cast<uint8_t*>(counts);
+        src_size = sizeof(counts);
+      } else if (data[1] >= SCHED_OVERRUN_SLOT) {
+        src = reinterpret_cast<uint8_t*>(
+            slice_watchdog.GetOverrun(data[1] - SCHED_OVERRUN_SLOT));
+        src_size = sizeof(OverrunRecord);
+      } else {
+        src = reinterpret_cast<uint8_t*>(profiler.GetStats(data[1]));
+        src_size = sizeof(TaskStats);
+      }
+      if (src && offset < src_size) {
+        memcpy(&keyboard_report, src + offset, sizeof(keyboard_report));
+      }
+      USBD_CUSTOM_HID_SendReport(
+          &hUsbDeviceFS, reinterpret_cast<uint8_t*>(&keyboard_report), 8);
+      _state = USB_STATE_HEADER;
+      break;
+    }
+    case USB_STATE_IR_STATS: {
+      // data[1] selects which 8 bytes of IrStats to send back, past the end
+      // reads as zero. 0xFF clears them instead.
+      keyboard_report = {0, 0, 0, 0, 0, 0, 0, 0};
+      size_t offset = data[1] * sizeof(keyboard_report);
+      if (data[1] == 0xFF) {
+        hitcon::ir::IrStatsReset();
+      } else if (offset < sizeof(hitcon::ir::g_ir_stats)) {
+        size_t len = sizeof(hitcon::ir::g_ir_stats) - offset;
+        if (len > sizeof(keyboard_report)) len = sizeof(keyboard_report);
+        memcpy(&keyboard_report,
+               reinterpret_cast<uint8_t*>(&hitcon::ir::g_ir_stats) + offset,
+               len);
+      }
+      USBD_CUSTOM_HID_SendReport(
+          &hUsbDeviceFS, reinterpret_cast<uint8_t*>(&keyboard_report), 8);
+      _state = USB_STATE_HEADER;
+      break;
+    }
     default:
       break;
   }
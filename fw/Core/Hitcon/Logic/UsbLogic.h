@@ -37,7 +37,9 @@ enum usb_state_t {
   USB_STATE_WRITE_MEM,
   USB_STATE_READ_MEM,
   USB_STATE_WRITING,
-  USB_STATE_WAITING  // waiting for flash service done
+  USB_STATE_WAITING,  // waiting for flash service done
+  USB_STATE_SCHED_STATS,
+  USB_STATE_IR_STATS
 };
 
 enum {  // script code definition
@@ -57,6 +59,9 @@ class UsbLogic {
   // run routine task every 20 ms
   static constexpr unsigned DELAY_INTERVAL = 20;
   static constexpr unsigned WAIT_INTERVAL = 10;
+  // USB_STATE_SCHED_STATS slots past the profiler's.
+  static constexpr uint8_t SCHED_OVERRUN_SLOT = 0x80;
+  static constexpr uint8_t SCHED_COUNT_SLOT = 0xFE;
 
   usb_state_t _state;
   int32_t _index;
@@ -0,0 +1,670 @@
+#ifdef HITCON_TEST_MODE
+
+// Simulates a room of badges sharing the IR channel, each sending packets with
+// retransmit to a base station that acknowledges them.
+//
+// Usage: bench-ir-channel [--badges N] [--seconds S] [--interval S]
+//                         [--size BYTES] [--ber P] [--room M] [--range M]
+//                         [--seed X] [--fec 0|1] [--multi-ack 0|1]
+//                         [--ack-hold MS] [--fast 0|1]
+//
+// Without --badges it sweeps 5, 15 and 30 badges. Each badge runs the badge
+// code that decides what goes on the air: IrMac, IrTxQueue, EncodePacket(),
+// IrDecoder and RetransmitQueue. What IrLogic and IrService do with them and
+// with the hardware is modelled here:
+// - The TX DMA plays a ring of two IR_SERVICE_TX_SIZE halves. Each half is
+//   filled as the other starts playing, from the frame while IrMac says
+//   Sending(), so a frame starts up to two halves after its release. The
+//   next frame in IrTxQueue starts as the last one is done, chained if IrMac
+//   lets it.
+// - RX gives IrMac and IrDecoder a byte of 8 samples at a time, and frames are
+//   released after every IR_BYTE_PER_RUN bytes.
+// - IrMac::Routine() every IR_MAC_ROUTINE_PERIOD ms and
+//   RetransmitQueue::Maintain() every 1s, like IrService and IrController.
+//   The hash is back on the Step() after StartHash(), and RetransmitQueue is
+//   pumped as each of its frames is done.
+// Every badge has its own RNG standing in for g_fast_random_pool and its own
+// clock phase for each of the above.
+//
+// The medium is on and off per sample. A receiver sees the OR of every
+// transmitter within --range of it, never itself, with each sample flipped at
+// --ber. Badges are placed at random in a --room square, with the base station
+// in the middle, so some badges can't hear each other. Packets have FEC if
+// --fec, IR_TX_FEC by default. With --multi-ack, the default, the base
+// station acknowledges up to MULTI_ACK_MAX packets in one
+// MultiAcknowledgePacket, once it has that many or the oldest has waited
+// --ack-hold, 500ms by default, and its transmitter is idle. Without it, it
+// sends an AcknowledgePacket per packet. With --fast every frame goes out on
+// IrPhy::kFast, as once IrLogic has negotiated it, IrPhy::kNormal by default.
+//
+// Reports first, for both PHYs, the airtime of a --size frame and the share
+// of them IrDecoder loses at --ber on a link of its own.
+//
+// Then, per run:
+// - offered: packets the badges made, drop: of those, found the retransmit
+//   queue full.
+// - deliver: share of offered packets the base station got.
+// - goodput: payload bytes of distinct packets the base station got, per s.
+// - collide: frames, ACKs included, that overlapped another frame at the base
+//   station.
+// - abort: frames IrMac dropped on hearing someone else after the release.
+// - tx ms: median time from RetransmitQueue::Push() to the first send.
+// - ack p50/p90: time from RetransmitQueue::Push() to the ACK.
+// - ack air: share of the time the base station is sending ACKs.
+// - retx: sends after the first, per packet sent.
+
+#include <Logic/IrDecoder.h>
+#include <Logic/IrMac.h>
+#include <Logic/IrRetransmit.h>
+#include <Logic/IrTxQueue.h>
+#include <Logic/pcg32.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+// packet_type in IrController.h.
+constexpr uint8_t kTypeAcknowledge = 3;
+constexpr uint8_t kTypeProximity = 4;
+constexpr uint8_t kTypeMultiAcknowledge = 12;
+// IrData header, ttl and type.
+constexpr size_t kIrDataHeader = 2;
+
+constexpr uint32_t kSamplesPerSecond = 38000 / IR_TICKS_PER_SAMPLE;
+constexpr uint32_t kRoutineSamples =
+    IR_MAC_ROUTINE_PERIOD * kSamplesPerSecond / 1000;
+constexpr uint32_t kMaintainSamples = kSamplesPerSecond;
+// The TX DMA entries are modelled as samples.
+static_assert(IR_TX_PULSE_PER_ENTRY == IR_TICKS_PER_SAMPLE);
+constexpr uint32_t kTxHalf = IR_SERVICE_TX_SIZE;
+constexpr uint32_t kRunBytes = IR_BYTE_PER_RUN;
+
+struct Config {
+  size_t badges = 30;
+  double seconds = 3600;
+  // Mean seconds between packets of a badge.
+  double interval = 30;
+  // IrData bytes, the default is a proximity packet.
+  size_t size = kIrDataHeader + 21;
+  double ber = 0;
+  bool fec = IR_TX_FEC;
+  bool multi_ack = true;
+  double ack_hold = 500;
+  bool fast = false;
+  double room = 6;
+  double range = 4;
+  uint64_t seed = 1;
+};
+
+struct Stats {
+  size_t offered = 0;
+  size_t queue_full = 0;
+  size_t sends = 0;
+  size_t retransmits = 0;
+  size_t frames = 0;
+  size_t collided = 0;
+  size_t aborts = 0;
+  size_t delivered = 0;
+  size_t delivered_bytes = 0;
+  size_t acked = 0;
+  std::vector<double> ack_latency;
+  std::vector<double> tx_latency;
+  // TX entries of the base station's frames.
+  size_t ack_entries = 0;
+};
+
+// TX entries of packet, header included, one sample each.
+size_t FrameEntries(const IrPacket &packet) {
+  if (packet.phy_ == IrPhy::kFast) {
+    return IR_PACKET_HEADER_FAST_SIZE * IR_TX_ENTRY_PER_HEADER_BIT +
+           packet.size_ * 8 * IR_TX_ENTRY_PER_DATA_BIT_FAST;
+  }
+  return IR_PACKET_HEADER_SIZE * IR_TX_ENTRY_PER_HEADER_BIT +
+         packet.size_ * 8 * IR_TX_ENTRY_PER_DATA_BIT;
+}
+
+// TX entry at of packet, what IrService::PopulateTxDmaBuffer() puts there.
+uint8_t FrameEntry(const IrPacket &packet, size_t at) {
+  bool fast = packet.phy_ == IrPhy::kFast;
+  size_t header =
+      (fast ? IR_PACKET_HEADER_FAST_SIZE : IR_PACKET_HEADER_SIZE) *
+      IR_TX_ENTRY_PER_HEADER_BIT;
+  if (at < header) {
+    const uint8_t *elements = fast ? IR_PACKET_HEADER_FAST : IR_PACKET_HEADER;
+    return elements[at / IR_TX_ENTRY_PER_HEADER_BIT];
+  }
+  size_t bit = (at - header) / (fast ? IR_TX_ENTRY_PER_DATA_BIT_FAST
+                                     : IR_TX_ENTRY_PER_DATA_BIT);
+  return (packet.data_[bit / 8] >> (bit % 8)) & 1;
+}
+
+uint64_t Hash(const uint8_t *data, size_t len) {
+  // FNV-1a, only needs to tell packets apart.
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ data[i]) * 1099511628211ull;
+  }
+  return h & ((1ull << (8 * PACKET_HASH_LEN)) - 1);
+}
+
+class Node {
+ public:
+  Node(size_t id, bool base, uint64_t seed, Stats *stats)
+      : id(id), base(base), rng(seed), stats(stats), retx(this),
+        tx_packet(nullptr), tx_pos(0), tx_frame_collided(false), frame_seq(0),
+        hash_pending(false) {
+    memset(tx_ring, 0, sizeof(tx_ring));
+    tx_has_frame[0] = tx_has_frame[1] = false;
+    decoder.SetOnPacket((hitcon::callback_t)&Node::OnPacket, this);
+    tx_phase = rng.GetRandom() % (2 * kTxHalf);
+    next_half = tx_phase;
+    run_phase = rng.GetRandom() % kRunBytes;
+    next_routine = rng.GetRandom() % kRoutineSamples;
+    next_maintain = rng.GetRandom() % kMaintainSamples;
+  }
+
+  size_t id;
+  bool base;
+  double x, y;
+  // Mean seconds between packets, and their size.
+  double interval;
+  size_t size;
+  bool fec;
+  IrPhy phy;
+  bool multi_ack;
+  // Samples a multi ACK waits for more.
+  uint64_t ack_hold;
+  uint64_t next_packet;
+  // Sample of the current Step().
+  uint64_t now;
+
+  // Port for RetransmitQueue.
+  bool StartHash(const uint8_t *data, size_t len) {
+    if (hash_pending) return false;
+    uint64_t h = Hash(data, len);
+    memcpy(hash_digest, &h, PACKET_HASH_LEN);
+    hash_pending = true;
+    return true;
+  }
+
+  bool CanSend() { return tx_queue.HasRoom(); }
+
+  // IrLogic::SendPacket().
+  bool Send(uint8_t *data, size_t len) {
+    if (!tx_queue.Push(data, len, TxPriority::kNormal, fec, phy, nullptr,
+                       nullptr)) {
+      return false;
+    }
+    if (mac.Idle()) StartTx();
+    uint64_t h = Hash(data, len);
+    if (!base && !sent.insert(h).second) {
+      stats->retransmits++;
+    } else if (!base) {
+      stats->sends++;
+      auto it = pushed_at.find(h);
+      if (it != pushed_at.end()) {
+        stats->tx_latency.push_back(static_cast<double>(now - it->second) /
+                                    kSamplesPerSecond);
+      }
+    }
+    return true;
+  }
+
+  void OnAcknowledgeTag(AckTag tag) { acked_now = true; }
+
+  uint32_t Random() { return rng.GetRandom(); }
+
+  // The TX DMA output for samples [s, s + 8).
+  uint8_t TxByte(uint64_t s) {
+    uint8_t byte = 0;
+    for (int i = 0; i < 8; i++) {
+      byte |= tx_ring[(s + i + 2 * kTxHalf - tx_phase) % (2 * kTxHalf)] << i;
+    }
+    return byte;
+  }
+
+  // A frame is in the TX DMA halves playing samples [s, s + 8).
+  bool OnAir(uint64_t s) {
+    return tx_has_frame[((s + 2 * kTxHalf - tx_phase) / kTxHalf) % 2] ||
+           tx_has_frame[((s + 7 + 2 * kTxHalf - tx_phase) / kTxHalf) % 2];
+  }
+
+  void MarkCollided() { tx_frame_collided = true; }
+
+  // Everything on this badge due by sample s, the start of RX byte byte_index.
+  void Step(uint64_t s, uint64_t byte_index) {
+    if (hash_pending) {
+      hash_pending = false;
+      retx.OnHashResult(hash_digest);
+    }
+    while (next_half <= s) {
+      // The half that just finished playing is refilled.
+      PopulateHalf(((next_half - tx_phase) / kTxHalf + 1) % 2);
+      next_half += kTxHalf;
+    }
+    if (byte_index % kRunBytes == run_phase) {
+      if (mac.TryRelease()) {
+        tx_pos = 0;
+        tx_frame_collided = false;
+      }
+    }
+    if (s >= next_routine) {
+      mac.Routine(rng.GetRandom());
+      next_routine += kRoutineSamples;
+    }
+    if (s >= next_maintain) {
+      if (!base) retx.Maintain();
+      next_maintain += kMaintainSamples;
+    }
+    if (base && multi_ack && !acks.empty() && mac.Idle() &&
+        (acks.size() >= MULTI_ACK_MAX || s >= ack_since + ack_hold)) {
+      uint8_t ack[kIrDataHeader + 1 + MULTI_ACK_MAX * MULTI_ACK_HASH_LEN] = {
+          0, kTypeMultiAcknowledge};
+      size_t count = 0;
+      for (; count < MULTI_ACK_MAX && !acks.empty(); count++) {
+        memcpy(ack + kIrDataHeader + 1 + count * MULTI_ACK_HASH_LEN,
+               &acks.front(), MULTI_ACK_HASH_LEN);
+        acks.pop_front();
+      }
+      ack[kIrDataHeader] = count;
+      Send(ack, kIrDataHeader + 1 + count * MULTI_ACK_HASH_LEN);
+    }
+    while (base && !multi_ack && !acks.empty() && tx_queue.HasRoom()) {
+      uint8_t ack[kIrDataHeader + PACKET_HASH_LEN] = {0, kTypeAcknowledge};
+      memcpy(ack + kIrDataHeader, &acks.front(), PACKET_HASH_LEN);
+      acks.pop_front();
+      Send(ack, sizeof(ack));
+    }
+    if (!base && s >= next_packet) {
+      NewPacket(s);
+    }
+  }
+
+  void OnRxByte(uint8_t byte) {
+    bool was_sending = mac.Sending();
+    mac.OnRxByte(byte);
+    if (was_sending && !mac.Sending()) stats->aborts++;
+    decoder.Push(byte);
+  }
+
+  void SetNextPacket(uint64_t s, double interval) {
+    double u = (rng.GetRandom() + 1.0) / 4294967296.0;
+    next_packet = s + static_cast<uint64_t>(-log(u) * interval *
+                                            kSamplesPerSecond);
+  }
+
+ private:
+  void NewPacket(uint64_t s) {
+    SetNextPacket(s, interval);
+    // ttl, type, then the badge and sequence number so every packet is
+    // different.
+    uint8_t data[MAX_PACKET_PAYLOAD_BYTES] = {0, kTypeProximity};
+    data[2] = id;
+    memcpy(data + 3, &frame_seq, sizeof(frame_seq));
+    frame_seq++;
+    for (size_t i = 3 + sizeof(frame_seq); i < size; i++) {
+      data[i] = rng.GetRandom();
+    }
+    stats->offered++;
+    uint64_t h = Hash(data, size);
+    pushed_at[h] = s;
+    if (!retx.Push(data, size, 3, AckTag::ACK_TAG_NONE)) {
+      stats->queue_full++;
+      pushed_at.erase(h);
+    }
+  }
+
+  // IrLogic::OnTxDone() and IrService::SendBuffer().
+  void StartTx() {
+    tx_packet = tx_queue.Pop();
+    if (!tx_packet) return;
+    if (mac.Chain()) {
+      tx_pos = 0;
+      tx_frame_collided = false;
+    } else {
+      mac.Request();
+    }
+  }
+
+  // IrService::PopulateTxDmaBuffer().
+  void PopulateHalf(int half) {
+    uint8_t *out = &tx_ring[half * kTxHalf];
+    tx_has_frame[half] = mac.Sending();
+    if (!mac.Sending()) {
+      memset(out, 0, kTxHalf);
+      return;
+    }
+    size_t frame = FrameEntries(*tx_packet);
+    for (size_t i = 0; i < kTxHalf; i++) {
+      size_t at = tx_pos + i;
+      out[i] = at < frame ? FrameEntry(*tx_packet, at) : 0;
+    }
+    tx_pos += kTxHalf;
+    if (tx_pos >= frame) {
+      mac.Done();
+      stats->frames++;
+      if (base) stats->ack_entries += frame;
+      if (tx_frame_collided) stats->collided++;
+      tx_queue.OnSent();
+      tx_queue.DeliverDone();
+      StartTx();
+      // IrController::OnRetransmitOut().
+      if (!base) retx.Pump();
+    }
+  }
+
+  void OnPacket(void *arg) {
+    IrPacket *packet = reinterpret_cast<IrPacket *>(arg);
+    const uint8_t *data = &packet->data_[1];
+    size_t len = packet->size_ - 1;
+    if (len < kIrDataHeader) return;
+    if (base) {
+      if (data[1] == kTypeAcknowledge || data[1] == kTypeMultiAcknowledge) {
+        return;
+      }
+      uint64_t h = Hash(data, len);
+      if (seen.insert(h).second) {
+        stats->delivered++;
+        stats->delivered_bytes += len;
+      }
+      // The ACK for a retransmit may have been lost, ACK again.
+      if (acks.empty()) ack_since = now;
+      if (acks.size() < 2 * MULTI_ACK_MAX) acks.push_back(h);
+      return;
+    }
+    // Hashes acknowledged, and how many bytes of each.
+    const uint8_t *hashes;
+    size_t count;
+    size_t hash_len;
+    if (data[1] == kTypeAcknowledge && len >= kIrDataHeader + PACKET_HASH_LEN) {
+      hashes = data + kIrDataHeader;
+      count = 1;
+      hash_len = PACKET_HASH_LEN;
+    } else if (data[1] == kTypeMultiAcknowledge && len > kIrDataHeader &&
+               data[kIrDataHeader] <= MULTI_ACK_MAX &&
+               len >= kIrDataHeader + 1 +
+                          data[kIrDataHeader] * MULTI_ACK_HASH_LEN) {
+      hashes = data + kIrDataHeader + 1;
+      count = data[kIrDataHeader];
+      hash_len = MULTI_ACK_HASH_LEN;
+    } else {
+      return;
+    }
+    acked_now = false;
+    if (count == 1 && hash_len == PACKET_HASH_LEN) {
+      retx.OnAcknowledge(hashes);
+    } else {
+      retx.OnAcknowledgeMulti(hashes, count);
+    }
+    if (!acked_now) return;
+    for (size_t i = 0; i < count; i++) {
+      uint64_t h = 0;
+      memcpy(&h, hashes + i * hash_len, hash_len);
+      uint64_t mask = (1ull << (8 * hash_len)) - 1;
+      for (auto it = pushed_at.begin(); it != pushed_at.end(); it++) {
+        if ((it->first & mask) != h) continue;
+        stats->acked++;
+        stats->ack_latency.push_back(static_cast<double>(now - it->second) /
+                                     kSamplesPerSecond);
+        pushed_at.erase(it);
+        break;
+      }
+    }
+  }
+
+  PCG32 rng;
+  Stats *stats;
+  IrMac mac;
+  IrDecoder decoder;
+  RetransmitQueue<Node> retx;
+  IrTxQueue tx_queue;
+
+  // In tx_queue, from its Pop().
+  IrPacket *tx_packet;
+  // One sample per entry, two halves.
+  uint8_t tx_ring[2 * kTxHalf];
+  bool tx_has_frame[2];
+  // Frame samples already in the ring.
+  size_t tx_pos;
+  bool tx_frame_collided;
+  uint32_t tx_phase;
+  uint64_t next_half;
+  uint32_t run_phase;
+  uint64_t next_routine;
+  uint64_t next_maintain;
+  uint32_t frame_seq;
+
+  bool hash_pending;
+  uint8_t hash_digest[PACKET_HASH_LEN];
+  bool acked_now;
+  std::map<uint64_t, uint64_t> pushed_at;
+  std::set<uint64_t> sent;
+
+  // Base station only.
+  std::deque<uint64_t> acks;
+  // When the oldest of acks came in.
+  uint64_t ack_since;
+  std::set<uint64_t> seen;
+};
+
+struct LinkResult {
+  double frame_ms;
+  double lost;
+};
+
+// Frames of cfg.size on phy, one at a time through a link that flips each
+// sample at cfg.ber, into IrDecoder.
+LinkResult Link(const Config &cfg, IrPhy phy) {
+  constexpr size_t kFrames = 20000;
+  PCG32 rng(cfg.seed);
+  IrDecoder decoder;
+  size_t got = 0;
+  decoder.SetOnPacket(
+      [](void *arg, void *packet) { (*static_cast<size_t *>(arg))++; }, &got);
+  IrTxQueue queue;
+  uint8_t data[MAX_PACKET_PAYLOAD_BYTES] = {0, kTypeProximity};
+  size_t entries = 0;
+  for (size_t f = 0; f < kFrames; f++) {
+    for (size_t i = kIrDataHeader; i < cfg.size; i++) data[i] = rng.GetRandom();
+    queue.Push(data, cfg.size, TxPriority::kNormal, cfg.fec, phy, nullptr,
+               nullptr);
+    IrPacket *packet = queue.Pop();
+    entries = FrameEntries(*packet);
+    // Quiet before and after, and IR_BYTE_PER_RUN runs like IrService.
+    std::vector<uint8_t> bytes(
+        (entries + 16 + 8 * IR_BYTE_PER_RUN) / (8 * IR_BYTE_PER_RUN) *
+        IR_BYTE_PER_RUN);
+    for (size_t at = 0; at < entries; at++) {
+      uint8_t sample = FrameEntry(*packet, at);
+      if (rng.GetRandom() / 4294967296.0 < cfg.ber) sample ^= 1;
+      bytes[(at + 8) / 8] |= sample << ((at + 8) % 8);
+    }
+    decoder.Decode(bytes.data(), bytes.size());
+    queue.OnSent();
+    queue.DeliverDone();
+  }
+  return {1000.0 * entries / kSamplesPerSecond,
+          1.0 - static_cast<double>(got) / kFrames};
+}
+
+double Percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+Stats Run(const Config &cfg) {
+  Stats stats;
+  PCG32 medium(cfg.seed);
+  std::vector<std::unique_ptr<Node>> nodes;
+  for (size_t i = 0; i <= cfg.badges; i++) {
+    bool base = i == cfg.badges;
+    nodes.emplace_back(new Node(i, base, cfg.seed * 1000 + i, &stats));
+    Node &n = *nodes.back();
+    if (base) {
+      n.x = n.y = cfg.room / 2;
+    } else {
+      n.x = medium.GetRandom() / 4294967296.0 * cfg.room;
+      n.y = medium.GetRandom() / 4294967296.0 * cfg.room;
+    }
+    n.interval = cfg.interval;
+    n.size = cfg.size;
+    n.fec = cfg.fec;
+    n.phy = cfg.fast ? IrPhy::kFast : IrPhy::kNormal;
+    n.multi_ack = cfg.multi_ack;
+    n.ack_hold = cfg.ack_hold * kSamplesPerSecond / 1000;
+    n.SetNextPacket(0, cfg.interval);
+  }
+  size_t count = nodes.size();
+  std::vector<bool> in_range(count * count);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < count; j++) {
+      double dx = nodes[i]->x - nodes[j]->x;
+      double dy = nodes[i]->y - nodes[j]->y;
+      in_range[i * count + j] =
+          i != j && dx * dx + dy * dy <= cfg.range * cfg.range;
+    }
+  }
+  size_t base = cfg.badges;
+
+  // Next flipped sample per receiver.
+  double log_keep = cfg.ber > 0 ? log(1 - cfg.ber) : 0;
+  auto next_error = [&](uint64_t s) -> uint64_t {
+    if (cfg.ber <= 0) return UINT64_MAX;
+    double u = (medium.GetRandom() + 1.0) / 4294967296.0;
+    return s + static_cast<uint64_t>(log(u) / log_keep);
+  };
+  std::vector<uint64_t> error_at(count);
+  for (size_t i = 0; i < count; i++) error_at[i] = next_error(0);
+
+  uint64_t bytes = static_cast<uint64_t>(cfg.seconds * kSamplesPerSecond) / 8;
+  std::vector<size_t> active;
+  std::vector<uint8_t> out(count);
+  for (uint64_t t = 0; t < bytes; t++) {
+    uint64_t s = t * 8;
+    for (auto &n : nodes) {
+      n->now = s;
+      n->Step(s, t);
+    }
+    active.clear();
+    size_t at_base = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (!nodes[i]->OnAir(s)) continue;
+      active.push_back(i);
+      out[i] = nodes[i]->TxByte(s);
+      if (in_range[i * count + base]) at_base++;
+    }
+    if (at_base > 1) {
+      for (size_t i : active) {
+        if (in_range[i * count + base]) nodes[i]->MarkCollided();
+      }
+    }
+    for (size_t r = 0; r < count; r++) {
+      uint8_t byte = 0;
+      for (size_t i : active) {
+        if (in_range[i * count + r]) byte |= out[i];
+      }
+      while (error_at[r] < s + 8) {
+        byte ^= 1 << (error_at[r] - s);
+        error_at[r] = next_error(error_at[r] + 1);
+      }
+      nodes[r]->OnRxByte(byte);
+    }
+  }
+  return stats;
+}
+
+void Print(const Config &cfg, const Stats &st) {
+  double offered = st.offered ? st.offered : 1;
+  double frames = st.frames ? st.frames : 1;
+  double sends = st.sends ? st.sends : 1;
+  printf("%6zu %7zu %6zu %6.1f%% %8.2f %6.1f%% %6zu %5.1f %7.1f %7.1f %5.2f "
+         "%6.2f%%\n",
+         cfg.badges, st.offered, st.queue_full,
+         100.0 * st.delivered / offered, st.delivered_bytes / cfg.seconds,
+         100.0 * st.collided / frames, st.aborts,
+         1000 * Percentile(st.tx_latency, 0.5), Percentile(st.ack_latency, 0.5),
+         Percentile(st.ack_latency, 0.9),
+         st.retransmits / sends,
+         100.0 * st.ack_entries / (cfg.seconds * kSamplesPerSecond));
+}
+
+bool ParseArg(int argc, char **argv, int *i, const char *name, double *val) {
+  if (strcmp(argv[*i], name) != 0 || *i + 1 >= argc) return false;
+  *val = atof(argv[++*i]);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Config cfg;
+  std::vector<size_t> sweep = {5, 15, 30};
+  for (int i = 1; i < argc; i++) {
+    double v;
+    if (ParseArg(argc, argv, &i, "--badges", &v)) {
+      sweep = {static_cast<size_t>(v)};
+    } else if (ParseArg(argc, argv, &i, "--seconds", &v)) {
+      cfg.seconds = v;
+    } else if (ParseArg(argc, argv, &i, "--interval", &v)) {
+      cfg.interval = v;
+    } else if (ParseArg(argc, argv, &i, "--size", &v)) {
+      cfg.size = static_cast<size_t>(v);
+    } else if (ParseArg(argc, argv, &i, "--fec", &v)) {
+      cfg.fec = v != 0;
+    } else if (ParseArg(argc, argv, &i, "--multi-ack", &v)) {
+      cfg.multi_ack = v != 0;
+    } else if (ParseArg(argc, argv, &i, "--ack-hold", &v)) {
+      cfg.ack_hold = v;
+    } else if (ParseArg(argc, argv, &i, "--fast", &v)) {
+      cfg.fast = v != 0;
+    } else if (ParseArg(argc, argv, &i, "--ber", &v)) {
+      cfg.ber = v;
+    } else if (ParseArg(argc, argv, &i, "--room", &v)) {
+      cfg.room = v;
+    } else if (ParseArg(argc, argv, &i, "--range", &v)) {
+      cfg.range = v;
+    } else if (ParseArg(argc, argv, &i, "--seed", &v)) {
+      cfg.seed = static_cast<uint64_t>(v);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (cfg.size < 3 + sizeof(uint32_t) ||
+      cfg.size + 3 > MAX_PACKET_PAYLOAD_BYTES) {
+    fprintf(stderr, "--size must be in [7, %zu]\n",
+            MAX_PACKET_PAYLOAD_BYTES - 3);
+    return 1;
+  }
+
+  LinkResult normal = Link(cfg, IrPhy::kNormal);
+  LinkResult fast = Link(cfg, IrPhy::kFast);
+  printf("frame normal %.1fms, %.2f%% lost, fast %.1fms, %.2f%% lost\n",
+         normal.frame_ms, 100 * normal.lost, fast.frame_ms, 100 * fast.lost);
+  printf("%.0fs, a packet per %.0fs of %zu bytes%s, ber %g, room %.1fm, "
+         "range %.1fm, %s ACKs, %s PHY\n",
+         cfg.seconds, cfg.interval, cfg.size, cfg.fec ? " with FEC" : "",
+         cfg.ber, cfg.room, cfg.range, cfg.multi_ack ? "multi" : "single",
+         cfg.fast ? "fast" : "normal");
+  printf("badges offered   drop deliver  goodput collide  abort tx ms "
+         "ack p50 ack p90  retx ack air\n");
+  for (size_t badges : sweep) {
+    cfg.badges = badges;
+    Print(cfg, Run(cfg));
+  }
+  return 0;
+}
+
+#endif  // HITCON_TEST_MODE
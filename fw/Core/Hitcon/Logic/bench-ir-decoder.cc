@@ -0,0 +1,259 @@
+#ifdef HITCON_TEST_MODE
+
+// Compares IrDecoder against the bit at a time decoder it replaced, on idle
+// line, back to back packets and random noise.
+//
+// Usage: bench-ir-decoder [runs]
+//
+// Reports host time and, on x86, TSC cycles per RX DMA half (IR_BYTE_PER_RUN
+// bytes). On the badge the decoder runs in the IrService RX DMA task, which
+// shows up in the scheduler profiler.
+
+#include <Logic/IrDecoder.h>
+#include <Logic/crc32.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace hitcon::ir;
+
+namespace {
+
+// The previous IrLogic::OnBufferReceived() without the task splitting and
+// suspender, kept for comparison.
+class LegacyDecoder {
+ public:
+  size_t packets = 0;
+
+  LegacyDecoder() { Clear(); }
+
+  void Decode(uint8_t *buffer, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      uint8_t current_byte = buffer[i];
+      for (uint8_t j = 0; j < 8; j++) {
+        uint8_t is_on = current_byte & 0x01;
+        current_byte = current_byte >> 1;
+        switch (packet_state) {
+          case STATE_START:
+            packet_buf <<= 1;
+            packet_buf |= is_on;
+            if ((packet_buf & IR_PACKET_HEADER_MASK) ==
+                (IR_PACKET_HEADER_PACKED & IR_PACKET_HEADER_MASK)) {
+              packet_state = STATE_SIZE;
+              rx_packet.size_ = 0;
+              packet_buf = 0;
+              bit = 0;
+            }
+            break;
+          case STATE_SIZE:
+            packet_buf++;
+            bit <<= 1;
+            bit |= is_on;
+            if ((packet_buf & 3) == 0) {
+              if (decode_bit(bit) == BIT_INVALID) {
+                packet_state = STATE_RESET;
+                return;
+              }
+              const uint8_t bitpos = (packet_buf / DECODE_SAMPLE_RATIO - 1);
+              rx_packet.size_ |= decode_bit(bit) << bitpos;
+              bit = 0;
+            }
+            if (packet_buf == DECODE_SAMPLE_RATIO * 8) {
+              if (rx_packet.size_ >= MAX_PACKET_PAYLOAD_BYTES) {
+                packet_state = STATE_RESET;
+              } else {
+                rx_packet.data_[0] = rx_packet.size_;
+                packet_state = STATE_DATA;
+                packet_buf = 0;
+              }
+            }
+            break;
+          case STATE_DATA:
+            packet_buf++;
+            bit <<= 1;
+            bit |= is_on;
+            if ((packet_buf % DECODE_SAMPLE_RATIO) == 0) {
+              if (decode_bit(bit) == BIT_INVALID) {
+                packet_state = STATE_RESET;
+                break;
+              }
+              const uint8_t pos =
+                  (packet_buf / DECODE_SAMPLE_RATIO - 1) / 8 + 1;
+              const uint8_t bitpos = (packet_buf / DECODE_SAMPLE_RATIO - 1) % 8;
+              rx_packet.data_[pos] |= decode_bit(bit) << bitpos;
+              if (pos == rx_packet.size_ - 2 && bitpos == 7) {
+                packet_state = STATE_CHKSUM;
+                break;
+              }
+            }
+            break;
+          case STATE_CHKSUM:
+            packet_buf++;
+            bit <<= 1;
+            bit |= is_on;
+            if ((packet_buf % DECODE_SAMPLE_RATIO) == 0) {
+              if (decode_bit(bit) == BIT_INVALID) {
+                packet_state = STATE_RESET;
+                break;
+              }
+              const uint8_t bitpos =
+                  (packet_buf / DECODE_SAMPLE_RATIO - 1) % IR_CHKSUM_SZ;
+              rx_packet.data_[rx_packet.size_ - 1] |= decode_bit(bit)
+                                                      << bitpos;
+              if (bitpos == IR_CHKSUM_SZ - 1) {
+                packet_buf = 0;
+                packet_state = STATE_RESET;
+                if (PacketChecksum(rx_packet.data_, rx_packet.size_ - 1) ==
+                    rx_packet.data_[rx_packet.size_ - 1]) {
+                  packets++;
+                }
+              }
+            }
+            break;
+          case STATE_RESET:
+            packet_state = STATE_START;
+            packet_buf = 0;
+            bit = 0;
+            Clear();
+            break;
+          default:
+            break;
+        }
+      }
+    }
+  }
+
+ private:
+  void Clear() {
+    memset(rx_packet.data_, 0, sizeof(rx_packet.data_));
+    rx_packet.size_ = 0;
+  }
+
+  enum PACKET_STATE {
+    STATE_START = 0,
+    STATE_SIZE = 1,
+    STATE_DATA = 2,
+    STATE_CHKSUM = 3,
+    STATE_RESET = 4,
+  };
+
+  enum BIT_STATE {
+    BIT_OFF = 0,
+    BIT_ON = 1,
+    BIT_INVALID = 2,
+  };
+
+  static uint8_t decode_bit(uint8_t x) {
+    uint8_t cnt = __builtin_popcount(x & 0b1111);
+    switch (cnt) {
+      case 0:
+      case 1:
+        return BIT_OFF;
+      case 3:
+      case 4:
+        return BIT_ON;
+      case 2:
+      default:
+        return BIT_INVALID;
+    }
+  }
+
+  size_t packet_buf = 0;
+  uint8_t packet_state = 0;
+  uint8_t bit = 0;
+  IrPacket rx_packet;
+};
+
+size_t new_packets = 0;
+
+void OnPacket(void *unused, void *packet) { new_packets++; }
+
+// Sample bytes of back to back packets with 28 byte payloads.
+std::vector<uint8_t> Traffic(size_t runs) {
+  std::vector<bool> samples;
+  unsigned seed = 0;
+  while (samples.size() < runs * IR_BYTE_PER_RUN * 8) {
+    samples.insert(samples.end(), 8, false);
+    for (uint8_t x : IR_PACKET_HEADER) {
+      samples.insert(samples.end(), DECODE_SAMPLE_RATIO / 2, x);
+    }
+    uint8_t raw[MAX_PACKET_PAYLOAD_BYTES];
+    size_t size = 30;
+    raw[0] = size;
+    for (size_t i = 1; i < size - 1; i++) raw[i] = seed++;
+    raw[size - 1] = PacketChecksum(raw, size - 1);
+    for (size_t i = 0; i < size; i++) {
+      for (int j = 0; j < 8; j++) {
+        samples.insert(samples.end(), DECODE_SAMPLE_RATIO, (raw[i] >> j) & 1);
+      }
+    }
+  }
+  std::vector<uint8_t> ret(runs * IR_BYTE_PER_RUN);
+  for (size_t i = 0; i < ret.size() * 8; i++) {
+    if (samples[i]) ret[i / 8] |= 1 << (i % 8);
+  }
+  return ret;
+}
+
+template <class F>
+void Measure(const char *name, size_t runs, F f) {
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+  uint64_t tsc_start = __rdtsc();
+#endif
+  for (size_t i = 0; i < runs; i++) f(i * IR_BYTE_PER_RUN);
+#ifdef HAVE_TSC
+  uint64_t tsc = __rdtsc() - tsc_start;
+#endif
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("  %-8s %8.1f ns/run", name, ns / runs);
+#ifdef HAVE_TSC
+  printf(" %8.1f cycles/run", static_cast<double>(tsc) / runs);
+#endif
+  printf("\n");
+}
+
+void Run(const char *scenario, std::vector<uint8_t> &bytes) {
+  size_t runs = bytes.size() / IR_BYTE_PER_RUN;
+  LegacyDecoder legacy;
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  new_packets = 0;
+  printf("scenario %s, %zu runs\n", scenario, runs);
+  Measure("legacy", runs, [&](size_t off) {
+    legacy.Decode(&bytes[off], IR_BYTE_PER_RUN);
+  });
+  Measure("table", runs, [&](size_t off) {
+    decoder.Decode(&bytes[off], IR_BYTE_PER_RUN);
+  });
+  printf("  packets: legacy %zu, table %zu\n", legacy.packets, new_packets);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t runs = argc > 1 ? atoi(argv[1]) : 100000;
+
+  std::vector<uint8_t> idle(runs * IR_BYTE_PER_RUN);
+  Run("idle", idle);
+
+  std::vector<uint8_t> traffic = Traffic(runs);
+  Run("traffic", traffic);
+
+  std::vector<uint8_t> noise(runs * IR_BYTE_PER_RUN);
+  srand(1);
+  for (uint8_t &b : noise) b = rand();
+  Run("noise", noise);
+  return 0;
+}
+
+#endif  // HITCON_TEST_MODE
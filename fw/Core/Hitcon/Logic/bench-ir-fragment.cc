@@ -0,0 +1,171 @@
+#ifdef HITCON_TEST_MODE
+
+// Airtime to get one message across, sent by Fragmenter or as one large
+// packet, on a channel where every TX entry is hit with probability p. A hit
+// stands for a bit error or another badge starting over us, and a frame with
+// one is lost, FEC aside. Longer frames are hit more often.
+//
+// Usage: bench-ir-fragment [--messages N] [--fec 0|1]
+//
+// Fragments go through Fragmenter with its selective repeat, the ACKs are
+// FragmentAckPacket. The large packet is what IrLogic would send if
+// MAX_PACKET_PAYLOAD_BYTES were big enough, with the same IrData header,
+// acknowledged like RetransmitQueue does and sent again whole until the ACK
+// is back, FRAGMENT_RETRIES times at most. Airtime counts every frame both
+// ways, including the header.
+
+#include <Logic/IrFragment.h>
+#include <Logic/pcg32.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+// IrData header, ttl and type.
+constexpr size_t kIrDataHeader = 2;
+// IrData of an AcknowledgePacket.
+constexpr size_t kAckSize = kIrDataHeader + 6;
+
+bool fec = IR_TX_FEC;
+PCG32 rng(1);
+
+// TX entries of a frame with an IrData of len bytes.
+size_t FrameEntries(size_t len) {
+  size_t bytes = 1 + len + 1 + (fec ? 1 + IR_FEC_PARITY_BYTES : 0);
+  return IR_PACKET_HEADER_SIZE * IR_TX_ENTRY_PER_HEADER_BIT +
+         bytes * 8 * IR_TX_ENTRY_PER_DATA_BIT;
+}
+
+double EntriesToMs(size_t entries) {
+  return entries * IR_TX_PULSE_PER_ENTRY / 38.0;
+}
+
+bool Hit(size_t entries, double p) {
+  double survive = pow(1 - p, entries);
+  return rng.GetRandom() / 4294967296.0 >= survive;
+}
+
+struct Result {
+  double entries = 0;
+  size_t delivered = 0;
+};
+
+class Node {
+ public:
+  explicit Node(uint8_t id) : frag(this) {
+    uint8_t sender[FRAGMENT_SENDER_LEN] = {id, 0};
+    frag.Init(sender, 0);
+  }
+
+  Fragmenter<Node> frag;
+  std::deque<std::vector<uint8_t>> *air;
+  bool got = false;
+  bool finished = false;
+
+  bool CanSend() { return true; }
+  bool SendFragment(const FragmentPacket &packet, size_t len) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&packet);
+    air->emplace_back(p, p + len);
+    return true;
+  }
+  bool SendFragmentAck(const FragmentAckPacket &ack) {
+    // Tell it from a fragment by the length.
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&ack);
+    air->emplace_back(p, p + sizeof(ack));
+    return true;
+  }
+  void OnMessage(const uint8_t *data, size_t len) { got = true; }
+  void OnMessageSent(bool acked) { finished = true; }
+};
+
+Result Fragmented(size_t len, double p, size_t messages) {
+  Result r;
+  std::vector<uint8_t> msg(len, 0x55);
+  for (size_t m = 0; m < messages; m++) {
+    std::deque<std::vector<uint8_t>> air;
+    Node a(1), b(2);
+    a.air = b.air = &air;
+    a.frag.Send(msg.data(), len);
+    while (!a.finished) {
+      while (!air.empty()) {
+        std::vector<uint8_t> f = air.front();
+        air.pop_front();
+        size_t entries = FrameEntries(kIrDataHeader + f.size());
+        r.entries += entries;
+        if (Hit(entries, p)) continue;
+        if (f.size() == sizeof(FragmentAckPacket)) {
+          FragmentAckPacket ack;
+          memcpy(&ack, f.data(), sizeof(ack));
+          a.frag.OnFragmentAck(ack);
+        } else {
+          FragmentPacket packet;
+          memcpy(&packet, f.data(), f.size());
+          b.frag.OnFragment(packet, f.size());
+        }
+      }
+      a.frag.Tick();
+      b.frag.Tick();
+    }
+    r.delivered += b.got;
+  }
+  return r;
+}
+
+Result Large(size_t len, double p, size_t messages) {
+  Result r;
+  size_t data = FrameEntries(kIrDataHeader + len);
+  size_t ack = FrameEntries(kAckSize);
+  for (size_t m = 0; m < messages; m++) {
+    bool got = false;
+    for (size_t tries = 0; tries <= FRAGMENT_RETRIES; tries++) {
+      r.entries += data;
+      if (Hit(data, p)) continue;
+      got = true;
+      r.entries += ack;
+      if (!Hit(ack, p)) break;
+    }
+    r.delivered += got;
+  }
+  return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t messages = 20000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--messages") == 0) {
+      messages = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--fec") == 0) {
+      fec = atoi(argv[i + 1]) != 0;
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  printf("%zu messages each, %zu byte fragments%s\n", messages,
+         FRAGMENT_DATA_SIZE, fec ? " with FEC" : "");
+  printf("bytes  hit/entry | fragmented ms deliver | large ms deliver\n");
+  size_t sizes[] = {50, 100, FRAGMENT_MAX_MESSAGE};
+  double hits[] = {0, 1e-4, 3e-4, 1e-3};
+  for (size_t len : sizes) {
+    for (double p : hits) {
+      Result f = Fragmented(len, p, messages);
+      Result l = Large(len, p, messages);
+      printf("%5zu %10g | %13.1f %6.1f%% | %8.1f %6.1f%%\n", len, p,
+             EntriesToMs(f.entries / messages), 100.0 * f.delivered / messages,
+             EntriesToMs(l.entries / messages), 100.0 * l.delivered / messages);
+    }
+  }
+  return 0;
+}
+
+#endif  // HITCON_TEST_MODE
@@ -0,0 +1,39 @@
+#ifndef HITCON_LOGIC_TEST_CHECK_H_
+#define HITCON_LOGIC_TEST_CHECK_H_
+
+#ifdef HITCON_TEST_MODE
+
+// CHECK() for the host tests, which keep going after a failed check so one
+// run shows them all. main() returns TestResult() at the end.
+
+#include <stdio.h>
+
+namespace hitcon {
+namespace test {
+
+inline int failures = 0;
+
+// Prints the outcome, returns the exit code of the test.
+inline int TestResult(const char *name) {
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("%s tests passed OK\n", name);
+  return 0;
+}
+
+}  // namespace test
+}  // namespace hitcon
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      hitcon::test::failures++;                                       \
+    }                                                                 \
+  } while (0)
+
+#endif  // HITCON_TEST_MODE
+
+#endif  // #ifndef HITCON_LOGIC_TEST_CHECK_H_
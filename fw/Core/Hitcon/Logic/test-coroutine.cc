@@ -0,0 +1,189 @@
+#ifdef HITCON_TEST_MODE
+
+// CoTask and its frame pool, and the two coroutines in the tree:
+// HashService::doHash() against sha3_HashBuffer() and
+// PointMultService::routineFunc() against the results of the double-and-add
+// state machine it replaced.
+
+#include <Logic/EcLogic.h>
+#include <Logic/keccak.h>
+#include <Logic/test-check.h>
+#include <Service/HashService.h>
+#include <Service/Sched/Coroutine.h>
+#include <Service/Sched/Scheduler.h>
+#include <Service/Sched/SysTimer.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+using namespace hitcon::service::sched;
+using namespace hitcon::ecc::internal;
+using namespace hitcon::hash;
+
+namespace {
+
+// Runs the scheduler until nothing is left to do.
+void Drain() { scheduler.RunUntil(SysTimer::GetTime() + 1); }
+
+std::vector<uint8_t> digest;
+size_t hashes_done = 0;
+
+void OnHash(void *unused, void *arg) {
+  HashResult *result = reinterpret_cast<HashResult *>(arg);
+  digest.assign(result->digest, result->digest + result->size);
+  hashes_done++;
+}
+
+void TestHash() {
+  // Around the 8 byte words and the 136 byte SHA3-256 block.
+  const size_t lengths[] = {0, 1, 4, 5, 135, 136, 137};
+  for (size_t len : lengths) {
+    std::vector<uint8_t> message(len);
+    for (size_t i = 0; i < len; i++) message[i] = i * 13 + len;
+    size_t done = hashes_done;
+    CHECK(g_hash_service.StartHash(message.data(), len, &OnHash, nullptr));
+    // Busy until the callback.
+    CHECK(!g_hash_service.StartHash(message.data(), len, &OnHash, nullptr));
+    Drain();
+    CHECK(hashes_done == done + 1);
+    uint8_t expected[SHA3_256_HASH_SIZE];
+    sha3_HashBuffer(256, SHA3_FLAGS_NONE, message.data(), len, expected,
+                    sizeof(expected));
+    CHECK(digest.size() == sizeof(expected) &&
+          memcmp(digest.data(), expected, sizeof(expected)) == 0);
+  }
+  CHECK(CoFrameHighWater() <= kCoFrameSizeBadge);
+}
+
+EcPoint mult_result;
+bool mult_done = false;
+
+void OnMult(void *unused, void *arg) {
+  mult_result = *reinterpret_cast<EcPoint *>(arg);
+  mult_done = true;
+}
+
+void TestPointMult() {
+  // From the state machine before PointMultService was a coroutine, the
+  // compact form of times * generator. The last one is the curve order - 1,
+  // minus the generator.
+  struct {
+    uint64_t times;
+    uint8_t compact[8];
+  } cases[] = {
+      {1, {0xcc, 0x6a, 0xb3, 0x33, 0xdc, 0x77, 0x9a, 0x01}},
+      {2, {0x3c, 0x40, 0xf0, 0xf9, 0x8a, 0x2e, 0x9a, 0x01}},
+      {3, {0x10, 0xa9, 0x5f, 0x8f, 0x04, 0x15, 0x24, 0x01}},
+      {0x1234567890abcd, {0x36, 0x19, 0x48, 0x19, 0xab, 0xc9, 0x27, 0x01}},
+      {0xbcffb09c43733c, {0xcc, 0x6a, 0xb3, 0x33, 0xdc, 0x77, 0x9a, 0x00}},
+  };
+  // The default is the generator.
+  PointMultContext generator;
+  for (auto &c : cases) {
+    mult_done = false;
+    g_point_mult_service.start(generator.p, c.times, &OnMult, nullptr);
+    Drain();
+    CHECK(mult_done);
+    uint8_t compact[8] = {};
+    CHECK(mult_result.getCompactForm(compact, sizeof(compact)));
+    CHECK(memcmp(compact, c.compact, sizeof(compact)) == 0);
+  }
+  CHECK(CoFrameHighWater() <= kCoFrameSizeBadge);
+
+  // Both coroutines at once, a frame each.
+  uint8_t message[20] = {1, 2, 3};
+  mult_done = false;
+  size_t done = hashes_done;
+  g_point_mult_service.start(generator.p, 2, &OnMult, nullptr);
+  CHECK(g_hash_service.StartHash(message, sizeof(message), &OnHash, nullptr));
+  Drain();
+  CHECK(mult_done && hashes_done == done + 1);
+}
+
+struct Counter {
+  int yields = 0;
+  int stage = 0;
+
+  Coroutine Yielding(int n) {
+    for (int i = 0; i < n; i++) {
+      yields++;
+      co_await YieldSlice();
+    }
+    stage = 1;
+  }
+
+  Coroutine Waiting() {
+    stage = 1;
+    co_await WaitWake();
+    stage = 2;
+  }
+};
+
+void TestYieldSlice() {
+  Counter c;
+  CoTask task(900);
+  CHECK(task.Start(c.Yielding(5)));
+  CHECK(task.IsRunning() && c.yields == 0);
+  size_t ran = scheduler.GetTotalTasksRan();
+  Drain();
+  // Once per slice, the task was queued again after every yield.
+  CHECK(c.yields == 5 && c.stage == 1);
+  CHECK(scheduler.GetTotalTasksRan() - ran == 6);
+  CHECK(!task.IsRunning());
+}
+
+void TestWaitWake() {
+  Counter c;
+  CoTask task(900);
+  CHECK(task.Start(c.Waiting()));
+  Drain();
+  // Not queued again, it waits for Wake().
+  CHECK(c.stage == 1 && task.IsRunning() && !task.IsQueued());
+  task.Wake();
+  Drain();
+  CHECK(c.stage == 2 && !task.IsRunning());
+}
+
+void TestPool() {
+  Counter a, b, c;
+  CoTask ta(900), tb(900), tc(900);
+  CHECK(ta.Start(a.Waiting()));
+  CHECK(tb.Start(b.Waiting()));
+  // Every frame is taken.
+  CHECK(!tc.Start(c.Waiting()));
+  CHECK(!tc.IsRunning() && !tc.IsQueued());
+  Drain();
+  CHECK(a.stage == 1 && b.stage == 1 && c.stage == 0);
+  // A finished coroutine gives its frame back.
+  ta.Wake();
+  Drain();
+  CHECK(a.stage == 2 && !ta.IsRunning());
+  CHECK(tc.Start(c.Waiting()));
+  Drain();
+  CHECK(c.stage == 1);
+  tb.Wake();
+  tc.Wake();
+  Drain();
+  CHECK(b.stage == 2 && c.stage == 2);
+  // Both are free again.
+  CHECK(ta.Start(a.Yielding(1)));
+  CHECK(tb.Start(b.Yielding(1)));
+  Drain();
+  CHECK(!ta.IsRunning() && !tb.IsRunning());
+}
+
+}  // namespace
+
+int main() {
+  TestHash();
+  TestPointMult();
+  TestYieldSlice();
+  TestWaitWake();
+  TestPool();
+  printf("largest coroutine frame %zu of %zu bytes\n", CoFrameHighWater(),
+         kCoFrameSizeBadge);
+  return hitcon::test::TestResult("Coroutine");
+}
+
+#endif  // HITCON_TEST_MODE
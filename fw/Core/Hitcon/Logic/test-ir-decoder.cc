@@ -0,0 +1,607 @@
+#ifdef HITCON_TEST_MODE
+
+#include <Logic/IrDecoder.h>
+#include <Logic/IrFec.h>
+#include <Logic/IrFragment.h>
+#include <Logic/IrRetransmit.h>
+#include <Logic/IrStats.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+std::vector<std::vector<uint8_t>> received;
+std::vector<uint32_t> received_crc;
+std::vector<IrPhy> received_phy;
+
+void OnPacket(void *unused, void *arg) {
+  IrPacket *packet = reinterpret_cast<IrPacket *>(arg);
+  received.emplace_back(packet->data_, packet->data_ + packet->size_);
+  received_crc.push_back(packet->crc_);
+  received_phy.push_back(packet->phy_);
+}
+
+// Samples the way IrService transmits them on phy, one bool per sample.
+struct Stream {
+  std::vector<bool> samples;
+  IrPhy phy = IrPhy::kNormal;
+
+  // Samples per data bit.
+  size_t Ratio() {
+    return phy == IrPhy::kFast ? DECODE_SAMPLE_RATIO_FAST : DECODE_SAMPLE_RATIO;
+  }
+
+  void Silence(size_t n) { samples.insert(samples.end(), n, false); }
+
+  void Header() {
+    if (phy == IrPhy::kFast) {
+      for (uint8_t x : IR_PACKET_HEADER_FAST) {
+        samples.insert(samples.end(), DECODE_SAMPLE_RATIO / 2, x);
+      }
+      return;
+    }
+    for (uint8_t x : IR_PACKET_HEADER) {
+      samples.insert(samples.end(), DECODE_SAMPLE_RATIO / 2, x);
+    }
+  }
+
+  void Byte(uint8_t byte) {
+    for (int i = 0; i < 8; i++) {
+      samples.insert(samples.end(), Ratio(), (byte >> i) & 1);
+    }
+  }
+
+  // Header, size, payload and checksum, returns the sample index of the
+  // first data bit.
+  size_t Packet(const std::vector<uint8_t> &payload) {
+    Silence(8);
+    Header();
+    size_t data_start = samples.size();
+    std::vector<uint8_t> raw;
+    raw.push_back(payload.size() + 2);
+    raw.insert(raw.end(), payload.begin(), payload.end());
+    raw.push_back(PacketChecksum(raw.data(), raw.size()));
+    for (uint8_t b : raw) Byte(b);
+    return data_start;
+  }
+
+  // Same from EncodePacket(), with FEC if fec.
+  size_t Encoded(const std::vector<uint8_t> &payload, bool fec) {
+    Silence(8);
+    Header();
+    size_t data_start = samples.size();
+    IrPacket packet;
+    EncodePacket(payload.data(), payload.size(), packet, fec);
+    for (size_t i = 0; i < packet.size_; i++) Byte(packet.data_[i]);
+    return data_start;
+  }
+
+  size_t FecPacket(const std::vector<uint8_t> &payload) {
+    return Encoded(payload, true);
+  }
+
+  // 2 of 4 samples on in data bit n after start, 1 of 2 for IrPhy::kFast.
+  void InvalidBit(size_t start, size_t n) {
+    size_t bit = start + n * Ratio();
+    for (size_t i = 0; i < Ratio(); i++) samples[bit + i] = i < Ratio() / 2;
+  }
+
+  // LSB first, padded to whole IR_BYTE_PER_RUN runs.
+  std::vector<uint8_t> Pack() {
+    std::vector<uint8_t> ret;
+    for (size_t i = 0; i < samples.size(); i++) {
+      if (i % 8 == 0) ret.push_back(0);
+      if (samples[i]) ret.back() |= 1 << (i % 8);
+    }
+    while (ret.size() % IR_BYTE_PER_RUN) ret.push_back(0);
+    return ret;
+  }
+};
+
+std::vector<uint8_t> Payload(size_t len, unsigned seed) {
+  std::vector<uint8_t> ret;
+  for (size_t i = 0; i < len; i++) ret.push_back(seed * 31 + i * 7);
+  return ret;
+}
+
+// Received form of payload, size first.
+std::vector<uint8_t> Expected(const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> ret;
+  ret.push_back(payload.size() + 1);
+  ret.insert(ret.end(), payload.begin(), payload.end());
+  return ret;
+}
+
+void Feed(IrDecoder &decoder, const std::vector<uint8_t> &bytes) {
+  received.clear();
+  received_crc.clear();
+  received_phy.clear();
+  for (size_t i = 0; i < bytes.size(); i += IR_BYTE_PER_RUN) {
+    decoder.Decode(&bytes[i], IR_BYTE_PER_RUN);
+  }
+}
+
+void TestAllLengthsAndPhases() {
+  for (size_t len = 0; len + 2 < MAX_PACKET_PAYLOAD_BYTES; len++) {
+    for (size_t phase = 0; phase < 8; phase++) {
+      IrDecoder decoder;
+      decoder.SetOnPacket(&OnPacket, nullptr);
+      Stream s;
+      s.Silence(phase);
+      std::vector<uint8_t> payload = Payload(len, phase);
+      s.Packet(payload);
+      s.Silence(64);
+      Feed(decoder, s.Pack());
+      CHECK(received.size() == 1 && received[0] == Expected(payload));
+      CHECK(received_phy == std::vector<IrPhy>({IrPhy::kNormal}));
+      CHECK(!decoder.InPacket());
+    }
+  }
+}
+
+void TestOneBadSamplePerBit() {
+  for (size_t phase = 0; phase < 8; phase++) {
+    IrDecoder decoder;
+    decoder.SetOnPacket(&OnPacket, nullptr);
+    Stream s;
+    s.Silence(phase);
+    std::vector<uint8_t> payload = Payload(20, 3);
+    size_t start = s.Packet(payload);
+    // Flip a different sample of every data bit.
+    for (size_t i = start; i + DECODE_SAMPLE_RATIO <= s.samples.size();
+         i += DECODE_SAMPLE_RATIO) {
+      size_t j = i + (i / DECODE_SAMPLE_RATIO) % DECODE_SAMPLE_RATIO;
+      s.samples[j] = !s.samples[j];
+    }
+    s.Silence(64);
+    Feed(decoder, s.Pack());
+    CHECK(received.size() == 1 && received[0] == Expected(payload));
+  }
+}
+
+void TestInvalidBitDropsPacket() {
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  size_t start = s.Packet(Payload(10, 1));
+  // 2 of 4 samples on in the 20th data bit.
+  size_t bit = start + 20 * DECODE_SAMPLE_RATIO;
+  s.samples[bit] = true;
+  s.samples[bit + 1] = true;
+  s.samples[bit + 2] = false;
+  s.samples[bit + 3] = false;
+  // The next packet still gets through.
+  std::vector<uint8_t> payload = Payload(10, 2);
+  s.Packet(payload);
+  s.Silence(64);
+  IrStatsReset();
+  Feed(decoder, s.Pack());
+  CHECK(received.size() == 1 && received[0] == Expected(payload));
+  CHECK(g_ir_stats.rx_invalid_data == 1);
+  CHECK(g_ir_stats.rx_packets == 1);
+}
+
+void TestBadChecksum() {
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  s.Packet(Payload(5, 1));
+  // Flip the last checksum bit.
+  for (size_t i = 0; i < DECODE_SAMPLE_RATIO; i++) {
+    size_t j = s.samples.size() - 1 - i;
+    s.samples[j] = !s.samples[j];
+  }
+  s.Silence(64);
+  IrStatsReset();
+  Feed(decoder, s.Pack());
+  CHECK(received.empty());
+  CHECK(!decoder.InPacket());
+  CHECK(g_ir_stats.rx_headers == 1);
+  CHECK(g_ir_stats.rx_bad_checksum == 1);
+}
+
+void TestBadSize() {
+  IrStatsReset();
+  for (uint8_t size : {0, 1, static_cast<int>(MAX_PACKET_PAYLOAD_BYTES), 255}) {
+    IrDecoder decoder;
+    decoder.SetOnPacket(&OnPacket, nullptr);
+    Stream s;
+    s.Silence(8);
+    s.Header();
+    s.Byte(size);
+    for (int i = 0; i < 255; i++) s.Byte(0xA5);
+    s.Silence(64);
+    Feed(decoder, s.Pack());
+    CHECK(received.empty());
+    CHECK(!decoder.InPacket());
+  }
+  CHECK(g_ir_stats.rx_bad_size == 4);
+}
+
+void TestBackToBack() {
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  std::vector<std::vector<uint8_t>> payloads;
+  for (unsigned i = 0; i < 10; i++) {
+    payloads.push_back(Payload(i * 3, i));
+    s.Packet(payloads.back());
+  }
+  s.Silence(64);
+  Feed(decoder, s.Pack());
+  CHECK(received.size() == payloads.size());
+  for (size_t i = 0; i < received.size() && i < payloads.size(); i++) {
+    CHECK(received[i] == Expected(payloads[i]));
+  }
+}
+
+void TestInPacketAcrossBuffers() {
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  s.Packet(Payload(25, 1));
+  s.Silence(64);
+  std::vector<uint8_t> bytes = s.Pack();
+  received.clear();
+  // The packet is 27 bytes, 108 sample bytes long.
+  decoder.Decode(&bytes[0], IR_BYTE_PER_RUN);
+  CHECK(decoder.InPacket());
+  decoder.Decode(&bytes[IR_BYTE_PER_RUN],
+                 bytes.size() - IR_BYTE_PER_RUN);
+  CHECK(!decoder.InPacket());
+  CHECK(received.size() == 1);
+}
+
+void TestFecCode() {
+  std::vector<uint8_t> data = Payload(30, 5);
+  data.resize(data.size() + IR_FEC_PARITY_BYTES);
+  FecEncode(data.data(), data.size() - IR_FEC_PARITY_BYTES,
+            &data[data.size() - IR_FEC_PARITY_BYTES]);
+  std::vector<uint8_t> copy = data;
+  CHECK(FecCorrect(copy.data(), copy.size(), nullptr, 0) && copy == data);
+  for (size_t i = 0; i < data.size(); i++) {
+    // Any one wrong byte.
+    for (unsigned e = 1; e < 256; e += 17) {
+      copy = data;
+      copy[i] ^= e;
+      CHECK(FecCorrect(copy.data(), copy.size(), nullptr, 0) && copy == data);
+    }
+    // Any two erased bytes, or one.
+    for (size_t j = 0; j < data.size(); j++) {
+      copy = data;
+      copy[i] = 0;
+      copy[j] ^= 0x5A;
+      uint8_t erased[] = {static_cast<uint8_t>(i), static_cast<uint8_t>(j)};
+      CHECK(FecCorrect(copy.data(), copy.size(), erased, i == j ? 1 : 2) &&
+            copy == data);
+    }
+  }
+  // Two wrong bytes aren't fixed into the codeword.
+  copy = data;
+  copy[3] ^= 1;
+  copy[7] ^= 1;
+  FecCorrect(copy.data(), copy.size(), nullptr, 0);
+  CHECK(copy != data);
+}
+
+void TestFecPacket() {
+  for (size_t len = 0; len + 2 < MAX_PACKET_PAYLOAD_BYTES; len++) {
+    IrDecoder decoder;
+    decoder.SetOnPacket(&OnPacket, nullptr);
+    Stream s;
+    std::vector<uint8_t> payload = Payload(len, 9);
+    s.FecPacket(payload);
+    s.Silence(64);
+    Feed(decoder, s.Pack());
+    CHECK(received.size() == 1 && received[0] == Expected(payload));
+    CHECK(!decoder.InPacket());
+  }
+}
+
+void TestLargestIrData() {
+  // IrData header, then a full FragmentPacket and a full
+  // MultiAcknowledgePacket, the largest ones IrController sends.
+  const size_t sizes[] = {2 + FRAGMENT_HEADER_SIZE + FRAGMENT_DATA_SIZE,
+                          2 + 1 + MULTI_ACK_MAX * MULTI_ACK_HASH_LEN};
+  for (size_t len : sizes) {
+    for (bool fec : {false, true}) {
+      IrDecoder decoder;
+      decoder.SetOnPacket(&OnPacket, nullptr);
+      Stream s;
+      std::vector<uint8_t> payload = Payload(len, 10);
+      s.Encoded(payload, fec);
+      s.Silence(64);
+      Feed(decoder, s.Pack());
+      CHECK(received.size() == 1 && received[0] == Expected(payload));
+    }
+  }
+}
+
+void TestSizeLimit() {
+  // The size byte and the checksum have to stay below
+  // MAX_PACKET_PAYLOAD_BYTES, so 29 bytes is the most a packet carries.
+  for (size_t len = MAX_PACKET_PAYLOAD_BYTES - 3;
+       len <= MAX_PACKET_PAYLOAD_BYTES - 1; len++) {
+    for (IrPhy phy : {IrPhy::kNormal, IrPhy::kFast}) {
+      for (bool fec : {false, true}) {
+        IrDecoder decoder;
+        decoder.SetOnPacket(&OnPacket, nullptr);
+        Stream s;
+        s.phy = phy;
+        std::vector<uint8_t> payload = Payload(len, 11);
+        s.Encoded(payload, fec);
+        s.Silence(64);
+        Feed(decoder, s.Pack());
+        if (len + 3 <= MAX_PACKET_PAYLOAD_BYTES) {
+          CHECK(received.size() == 1 && received[0] == Expected(payload));
+        } else {
+          CHECK(received.empty());
+        }
+        CHECK(!decoder.InPacket());
+      }
+    }
+  }
+}
+
+void TestFecFixesPacket() {
+  std::vector<uint8_t> payload = Payload(20, 4);
+  // Mark, size, payload, checksum and parity.
+  size_t bits = 8 * (payload.size() + 3 + IR_FEC_PARITY_BYTES);
+  for (size_t a = 16; a < bits; a += 11) {
+    // Invalid bits in two bytes after the size byte, two in the first.
+    IrDecoder decoder;
+    decoder.SetOnPacket(&OnPacket, nullptr);
+    Stream s;
+    size_t start = s.FecPacket(payload);
+    size_t b = 16 + (a + 37) % (bits - 16);
+    s.InvalidBit(start, a);
+    s.InvalidBit(start, a ^ 1);
+    s.InvalidBit(start, b);
+    s.Silence(64);
+    Feed(decoder, s.Pack());
+    CHECK(received.size() == 1 && received[0] == Expected(payload));
+
+    // A wrong bit, all of its samples flipped.
+    Stream w;
+    start = w.FecPacket(payload);
+    for (size_t i = 0; i < DECODE_SAMPLE_RATIO; i++) {
+      size_t j = start + a * DECODE_SAMPLE_RATIO + i;
+      w.samples[j] = !w.samples[j];
+    }
+    w.Silence(64);
+    Feed(decoder, w.Pack());
+    CHECK(received.size() == 1 && received[0] == Expected(payload));
+  }
+
+  // Three erased bytes are too many.
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  size_t start = s.FecPacket(payload);
+  s.InvalidBit(start, 10);
+  s.InvalidBit(start, 20);
+  s.InvalidBit(start, 30);
+  std::vector<uint8_t> next = Payload(5, 1);
+  s.FecPacket(next);
+  s.Silence(64);
+  Feed(decoder, s.Pack());
+  CHECK(received.size() == 1 && received[0] == Expected(next));
+
+  // A plain packet still ends on an invalid bit.
+  Stream p;
+  start = p.Packet(payload);
+  p.InvalidBit(start, 20);
+  p.Silence(64);
+  Feed(decoder, p.Pack());
+  CHECK(received.empty());
+  CHECK(g_ir_stats.rx_invalid_data == 1);
+
+  // Erasures FEC fixed or not are counted, after the size byte.
+  IrStatsReset();
+  Stream f;
+  start = f.FecPacket(payload);
+  f.InvalidBit(start, 20);
+  start = f.FecPacket(payload);
+  f.InvalidBit(start, 20);
+  f.InvalidBit(start, 30);
+  f.InvalidBit(start, 40);
+  f.Silence(64);
+  Feed(decoder, f.Pack());
+  CHECK(received.size() == 1);
+  CHECK(g_ir_stats.rx_fec_fixed == 1);
+  CHECK(g_ir_stats.rx_invalid_fec == 1);
+}
+
+void TestFingerprint() {
+  // A copy FEC fixed has the fingerprint of a clean one, another packet
+  // doesn't.
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  std::vector<uint8_t> payload = Payload(12, 5);
+  Stream s;
+  s.FecPacket(payload);
+  size_t start = s.FecPacket(payload);
+  s.InvalidBit(start, 30);
+  s.FecPacket(Payload(12, 6));
+  s.Silence(64);
+  Feed(decoder, s.Pack());
+  CHECK(received.size() == 3 && received_crc.size() == 3);
+  if (received_crc.size() == 3) {
+    CHECK(received_crc[0] == received_crc[1]);
+    CHECK(received_crc[0] != received_crc[2]);
+  }
+}
+
+void TestFastAllLengthsAndPhases() {
+  for (size_t len = 0; len + 2 < MAX_PACKET_PAYLOAD_BYTES; len++) {
+    for (size_t phase = 0; phase < 8; phase++) {
+      IrDecoder decoder;
+      decoder.SetOnPacket(&OnPacket, nullptr);
+      Stream s;
+      s.phy = IrPhy::kFast;
+      s.Silence(phase);
+      std::vector<uint8_t> payload = Payload(len, phase);
+      s.Packet(payload);
+      s.FecPacket(payload);
+      s.Silence(64);
+      Feed(decoder, s.Pack());
+      CHECK(received.size() == 2);
+      for (const std::vector<uint8_t> &r : received) {
+        CHECK(r == Expected(payload));
+      }
+      CHECK(received_phy ==
+            std::vector<IrPhy>({IrPhy::kFast, IrPhy::kFast}));
+      CHECK(!decoder.InPacket());
+    }
+  }
+}
+
+void TestFastInvalidBit() {
+  // A bad sample is an erasure, FEC fixes two bytes of them.
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  std::vector<uint8_t> payload = Payload(20, 7);
+  Stream s;
+  s.phy = IrPhy::kFast;
+  size_t start = s.FecPacket(payload);
+  s.InvalidBit(start, 20);
+  s.InvalidBit(start, 21);
+  s.InvalidBit(start, 100);
+  start = s.FecPacket(payload);
+  s.InvalidBit(start, 20);
+  s.InvalidBit(start, 30);
+  s.InvalidBit(start, 40);
+  // A plain packet ends on it.
+  start = s.Packet(payload);
+  s.InvalidBit(start, 20);
+  s.Silence(64);
+  IrStatsReset();
+  Feed(decoder, s.Pack());
+  CHECK(received.size() == 1 && received[0] == Expected(payload));
+  CHECK(g_ir_stats.rx_fec_fixed == 1);
+  CHECK(g_ir_stats.rx_invalid_fec == 1);
+  CHECK(g_ir_stats.rx_invalid_data == 1);
+}
+
+void TestMixedPhy() {
+  // Each packet on its own PHY, back to back, and neither header taken for
+  // the other.
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Stream s;
+  std::vector<IrPhy> phys;
+  std::vector<std::vector<uint8_t>> payloads;
+  for (unsigned i = 0; i < 12; i++) {
+    s.phy = (i % 3 == 1) ? IrPhy::kNormal : IrPhy::kFast;
+    phys.push_back(s.phy);
+    payloads.push_back(Payload(i * 2, i));
+    s.FecPacket(payloads.back());
+  }
+  s.Silence(64);
+  IrStatsReset();
+  Feed(decoder, s.Pack());
+  CHECK(received_phy == phys);
+  CHECK(received.size() == payloads.size());
+  for (size_t i = 0; i < received.size() && i < payloads.size(); i++) {
+    CHECK(received[i] == Expected(payloads[i]));
+  }
+  CHECK(g_ir_stats.rx_headers == payloads.size());
+}
+
+// The low byte of GPIOA IDR at each sample, as the RX DMA leaves it, the
+// receiver pin low for a 1 and the other pins random.
+std::vector<uint8_t> ToIdr(const std::vector<uint8_t> &packed) {
+  std::vector<uint8_t> ret;
+  for (uint8_t byte : packed) {
+    for (int j = 0; j < 8; j++) {
+      uint8_t idr = rand() & ~(1 << IR_RX_IDR_BIT);
+      if (!((byte >> j) & 1)) idr |= 1 << IR_RX_IDR_BIT;
+      ret.push_back(idr);
+    }
+  }
+  return ret;
+}
+
+void TestPackRxSamples() {
+  srand(2);
+  for (unsigned byte = 0; byte < 256; byte++) {
+    for (int k = 0; k < 16; k++) {
+      std::vector<uint8_t> idr = ToIdr({static_cast<uint8_t>(byte)});
+      // The bit at a time loop IrService had.
+      uint8_t want = 0;
+      for (size_t j = 0; j < 8; j++) {
+        bool cbit = !static_cast<bool>(idr[j] & (1 << IR_RX_IDR_BIT));
+        want |= (-static_cast<int8_t>(cbit)) & (1 << j);
+      }
+      CHECK(want == byte);
+      CHECK(PackRxSamples(idr.data()) == want);
+    }
+  }
+
+  // Packets through the RX DMA bytes decode the same.
+  Stream s;
+  std::vector<std::vector<uint8_t>> payloads;
+  for (unsigned i = 0; i < 8; i++) {
+    s.phy = i % 2 ? IrPhy::kFast : IrPhy::kNormal;
+    payloads.push_back(Payload(i * 4, i));
+    s.FecPacket(payloads.back());
+  }
+  s.Silence(64);
+  std::vector<uint8_t> bytes = s.Pack();
+  std::vector<uint8_t> idr = ToIdr(bytes);
+  std::vector<uint8_t> packed;
+  for (size_t i = 0; i < idr.size(); i += 8) {
+    packed.push_back(PackRxSamples(&idr[i]));
+  }
+  CHECK(packed == bytes);
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  Feed(decoder, packed);
+  CHECK(received.size() == payloads.size());
+  for (size_t i = 0; i < received.size() && i < payloads.size(); i++) {
+    CHECK(received[i] == Expected(payloads[i]));
+  }
+}
+
+void TestNoise() {
+  // Random samples shouldn't crash it or produce packets.
+  IrDecoder decoder;
+  decoder.SetOnPacket(&OnPacket, nullptr);
+  srand(1);
+  std::vector<uint8_t> bytes(IR_BYTE_PER_RUN * 1000);
+  for (uint8_t &b : bytes) b = rand();
+  Feed(decoder, bytes);
+  CHECK(received.empty());
+}
+
+}  // namespace
+
+int main() {
+  TestAllLengthsAndPhases();
+  TestOneBadSamplePerBit();
+  TestInvalidBitDropsPacket();
+  TestBadChecksum();
+  TestBadSize();
+  TestBackToBack();
+  TestInPacketAcrossBuffers();
+  TestFecCode();
+  TestFecPacket();
+  TestLargestIrData();
+  TestSizeLimit();
+  TestFecFixesPacket();
+  TestFingerprint();
+  TestFastAllLengthsAndPhases();
+  TestFastInvalidBit();
+  TestMixedPhy();
+  TestPackRxSamples();
+  TestNoise();
+  return hitcon::test::TestResult("IrDecoder");
+}
+
+#endif  // HITCON_TEST_MODE
@@ -0,0 +1,66 @@
+#ifdef HITCON_TEST_MODE
+
+// DuplicateFilter, the recent packet cache in front of IrController.
+
+#include <Logic/IrDedup.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+
+using namespace hitcon::ir;
+
+namespace {
+
+void TestWindow() {
+  DuplicateFilter filter;
+  CHECK(!filter.Seen(0x12345678));
+  CHECK(!filter.Seen(0x12345679));
+  for (int i = 0; i < DEDUP_TICKS - 1; i++) filter.Tick();
+  CHECK(filter.Seen(0x12345678));
+  // The copy started the window again, the other one is gone.
+  for (int i = 0; i < DEDUP_TICKS - 1; i++) filter.Tick();
+  CHECK(filter.Seen(0x12345678));
+  filter.Tick();
+  CHECK(!filter.Seen(0x12345679));
+  CHECK(filter.Seen(0x12345679));
+}
+
+void TestRetries() {
+  // Every copy RetransmitQueue sends, each after the longest wait.
+  DuplicateFilter filter;
+  CHECK(!filter.Seen(0xcafe));
+  for (int retry = 0; retry < 3; retry++) {
+    for (int i = 0; i < RETX_RETRY_TICKS + RETX_RETRY_JITTER; i++) {
+      filter.Tick();
+    }
+    CHECK(filter.Seen(0xcafe));
+  }
+}
+
+void TestOldestEvicted() {
+  DuplicateFilter filter;
+  for (uint32_t i = 0; i < DEDUP_SLOTS; i++) CHECK(!filter.Seen(i));
+  for (uint32_t i = 0; i < DEDUP_SLOTS; i++) CHECK(filter.Seen(i));
+  CHECK(!filter.Seen(DEDUP_SLOTS));
+  // 0 made room for it, the rest stay.
+  for (uint32_t i = 1; i <= DEDUP_SLOTS; i++) CHECK(filter.Seen(i));
+  CHECK(!filter.Seen(0));
+}
+
+void TestZero() {
+  // A fingerprint of 0 isn't taken for a free slot.
+  DuplicateFilter filter;
+  CHECK(!filter.Seen(0));
+  CHECK(filter.Seen(0));
+}
+
+}  // namespace
+
+int main() {
+  TestWindow();
+  TestRetries();
+  TestOldestEvicted();
+  TestZero();
+  return hitcon::test::TestResult("DuplicateFilter");
+}
+
+#endif  // HITCON_TEST_MODE
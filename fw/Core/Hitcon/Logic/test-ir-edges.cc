@@ -0,0 +1,229 @@
+#ifdef HITCON_TEST_MODE
+
+// Runs the same IR waveform through both receivers: sampling the line every
+// IR_TICKS_PER_SAMPLE ticks like the GPIO DMA receiver, and IrEdgeSampler on
+// the edge timestamps like the input capture receiver.
+
+#include <Logic/IrDecoder.h>
+#include <Logic/IrEdgeSampler.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+std::vector<std::vector<uint8_t>> received;
+
+void OnPacket(void *unused, void *arg) {
+  IrPacket *packet = reinterpret_cast<IrPacket *>(arg);
+  received.emplace_back(packet->data_, packet->data_ + packet->size_);
+}
+
+// Line level per tick, the way IrService transmits.
+struct Waveform {
+  std::vector<bool> ticks;
+
+  void Level(bool on, size_t n) { ticks.insert(ticks.end(), n, on); }
+
+  void Packet(const std::vector<uint8_t> &payload) {
+    Level(false, 32);
+    for (uint8_t x : IR_PACKET_HEADER) Level(x, PULSE_PER_HEADER_BIT);
+    std::vector<uint8_t> raw;
+    raw.push_back(payload.size() + 2);
+    raw.insert(raw.end(), payload.begin(), payload.end());
+    raw.push_back(PacketChecksum(raw.data(), raw.size()));
+    for (uint8_t b : raw) {
+      for (int i = 0; i < 8; i++) Level((b >> i) & 1, PULSE_PER_DATA_BIT);
+    }
+  }
+
+  // Move every edge by up to jitter ticks either way, the receiver module
+  // doesn't switch exactly on the pulse boundary.
+  void Jitter(int jitter) {
+    std::vector<bool> out = ticks;
+    for (size_t i = 1; i < ticks.size(); i++) {
+      if (ticks[i] == ticks[i - 1]) continue;
+      int shift = rand() % (2 * jitter + 1) - jitter;
+      for (int j = 0; j < shift && i + j < ticks.size(); j++) {
+        out[i + j] = ticks[i - 1];
+      }
+      for (int j = 1; j <= -shift && i >= j; j++) out[i - j] = ticks[i];
+    }
+    ticks = out;
+  }
+};
+
+// What the GPIO receiver sees in whole bytes, sample s read at tick 4s + 2.
+std::vector<uint8_t> SampleBytes(const Waveform &w) {
+  size_t samples = (w.ticks.size() + 1) / IR_TICKS_PER_SAMPLE;
+  std::vector<uint8_t> ret(samples / 8);
+  for (size_t s = 0; s < ret.size() * 8; s++) {
+    if (w.ticks[s * IR_TICKS_PER_SAMPLE + 2]) ret[s / 8] |= 1 << (s % 8);
+  }
+  return ret;
+}
+
+struct Sink {
+  IrDecoder *decoder;
+  std::vector<uint8_t> bytes;
+  size_t silence_calls = 0;
+
+  void OnRxByte(uint8_t byte) {
+    bytes.push_back(byte);
+    decoder->Push(byte);
+  }
+
+  void OnRxSilence(size_t n) {
+    bytes.insert(bytes.end(), n, 0);
+    silence_calls++;
+    decoder->PushSilence(n);
+  }
+};
+
+// Feeds the edges of w to an IrEdgeSampler, with the timer at start on the
+// first tick and the RX task running every pull_every ticks. start is a
+// multiple of 32 ticks so the bytes line up with SampleBytes().
+std::vector<uint8_t> EdgeBytes(const Waveform &w, uint16_t start,
+                               size_t pull_every, IrDecoder *decoder,
+                               size_t *silence_calls) {
+  Sink sink{decoder};
+  IrEdgeSampler<Sink> sampler;
+  sampler.Advance(start, &sink);
+  sink.bytes.clear();
+  sink.silence_calls = 0;
+  for (size_t i = 1; i < w.ticks.size(); i++) {
+    uint16_t tick = start + i;
+    if (w.ticks[i] != w.ticks[i - 1]) sampler.Edge(tick, w.ticks[i], &sink);
+    if (i % pull_every == 0) sampler.Advance(tick, &sink);
+  }
+  sampler.Advance(start + w.ticks.size(), &sink);
+  *silence_calls = sink.silence_calls;
+  return sink.bytes;
+}
+
+std::vector<uint8_t> Payload(size_t len, unsigned seed) {
+  std::vector<uint8_t> ret;
+  for (size_t i = 0; i < len; i++) ret.push_back(seed * 31 + i * 7);
+  return ret;
+}
+
+std::vector<uint8_t> Expected(const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> ret;
+  ret.push_back(payload.size() + 1);
+  ret.insert(ret.end(), payload.begin(), payload.end());
+  return ret;
+}
+
+// Both receivers give the same packets, from the same bytes.
+void TestSameAsSampling() {
+  srand(1);
+  for (int jitter = 0; jitter <= 1; jitter++) {
+    for (size_t phase = 0; phase < 32; phase++) {
+      Waveform w;
+      w.Level(false, phase);
+      std::vector<std::vector<uint8_t>> payloads;
+      for (unsigned i = 0; i < 5; i++) {
+        payloads.push_back(Payload(i * 6, i + phase));
+        w.Packet(payloads.back());
+        w.Level(false, phase * 16);
+      }
+      w.Level(false, 600);
+      if (jitter) w.Jitter(jitter);
+
+      std::vector<uint8_t> sampled = SampleBytes(w);
+      IrDecoder sampling;
+      sampling.SetOnPacket(&OnPacket, nullptr);
+      received.clear();
+      sampling.Decode(sampled.data(), sampled.size());
+      std::vector<std::vector<uint8_t>> from_sampling = received;
+
+      IrDecoder capture;
+      capture.SetOnPacket(&OnPacket, nullptr);
+      received.clear();
+      size_t silence_calls;
+      // Start near the timer wrap and pull at odd times.
+      std::vector<uint8_t> edges = EdgeBytes(w, 0xFF00 - phase * 32,
+                                             37 + phase * 5, &capture,
+                                             &silence_calls);
+
+      CHECK(edges == sampled);
+      CHECK(received == from_sampling);
+      CHECK(received.size() == payloads.size());
+      for (size_t i = 0; i < received.size() && i < payloads.size(); i++) {
+        CHECK(received[i] == Expected(payloads[i]));
+      }
+      CHECK(!capture.InPacket());
+    }
+  }
+}
+
+// A long idle line is a handful of OnRxSilence() calls, not a call per byte.
+void TestIdleIsCheap() {
+  Waveform w;
+  w.Level(false, 60000);
+  IrDecoder decoder;
+  size_t silence_calls;
+  std::vector<uint8_t> edges =
+      EdgeBytes(w, 1280, 3000, &decoder, &silence_calls);
+  CHECK(edges.size() == 60000 / IR_TICKS_PER_SAMPLE / 8);
+  CHECK(silence_calls <= 21);
+}
+
+// Silence in the middle of a packet still completes it, and a header whose
+// last samples are in the first silent byte is still found.
+void TestPushSilence() {
+  std::vector<uint8_t> payload = Payload(1, 3);
+  for (size_t phase = 0; phase < 8; phase++) {
+    std::vector<bool> samples(phase, false);
+    for (uint8_t x : IR_PACKET_HEADER) {
+      samples.insert(samples.end(), DECODE_SAMPLE_RATIO / 2, x);
+    }
+    std::vector<uint8_t> raw = {3, payload[0]};
+    raw.push_back(PacketChecksum(raw.data(), raw.size()));
+    for (uint8_t b : raw) {
+      for (int i = 0; i < 8; i++) {
+        samples.insert(samples.end(), DECODE_SAMPLE_RATIO, (b >> i) & 1);
+      }
+    }
+    // Cut the packet after its last on sample, the rest is silence.
+    while (!samples.back()) samples.pop_back();
+    std::vector<uint8_t> bytes((samples.size() + 7) / 8);
+    for (size_t i = 0; i < samples.size(); i++) {
+      if (samples[i]) bytes[i / 8] |= 1 << (i % 8);
+    }
+    IrDecoder decoder;
+    decoder.SetOnPacket(&OnPacket, nullptr);
+    received.clear();
+    decoder.Decode(bytes.data(), bytes.size());
+    decoder.PushSilence(1000);
+    CHECK(received.size() == 1 && received[0] == Expected(payload));
+    CHECK(!decoder.InPacket());
+
+    // Only the header, cut after its last on sample.
+    samples.resize(phase + IR_PACKET_HEADER_SIZE * DECODE_SAMPLE_RATIO / 2);
+    while (!samples.back()) samples.pop_back();
+    bytes.assign((samples.size() + 7) / 8, 0);
+    for (size_t i = 0; i < samples.size(); i++) {
+      if (samples[i]) bytes[i / 8] |= 1 << (i % 8);
+    }
+    IrDecoder header_only;
+    header_only.Decode(bytes.data(), bytes.size());
+    header_only.PushSilence(1);
+    CHECK(header_only.InPacket());
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestSameAsSampling();
+  TestIdleIsCheap();
+  TestPushSilence();
+  return hitcon::test::TestResult("IrEdgeSampler");
+}
+
+#endif  // HITCON_TEST_MODE
@@ -0,0 +1,332 @@
+#ifdef HITCON_TEST_MODE
+
+// Fragmenter between badges on a link that loses the frames we pick.
+
+#include <Logic/IrFragment.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+struct Frame {
+  bool ack;
+  size_t from;
+  std::vector<uint8_t> bytes;
+};
+
+class Badge;
+
+// Every frame reaches every other badge unless drop says so.
+struct Link {
+  std::vector<Badge *> badges;
+  std::deque<Frame> air;
+  std::function<bool(const Frame &)> drop = [](const Frame &) {
+    return false;
+  };
+  size_t fragments = 0;
+  size_t acks = 0;
+
+  void Run();
+};
+
+class Badge {
+ public:
+  Badge(Link *link, uint8_t id, bool init = true)
+      : link(link), id(link->badges.size()), frag(this) {
+    link->badges.push_back(this);
+    uint8_t sender[FRAGMENT_SENDER_LEN] = {id, 0x5A};
+    if (init) frag.Init(sender, 100);
+  }
+
+  Link *link;
+  size_t id;
+  Fragmenter<Badge> frag;
+  // Frames the transmitter takes before the link runs.
+  size_t room = 100;
+
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<bool> sent;
+
+  // Port.
+  bool CanSend() { return room > 0; }
+
+  bool SendFragment(const FragmentPacket &packet, size_t len) {
+    if (!room) return false;
+    room--;
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&packet);
+    link->air.push_back({false, id, std::vector<uint8_t>(p, p + len)});
+    return true;
+  }
+
+  bool SendFragmentAck(const FragmentAckPacket &ack) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&ack);
+    link->air.push_back({true, id, std::vector<uint8_t>(p, p + sizeof(ack))});
+    return true;
+  }
+
+  void OnMessage(const uint8_t *data, size_t len) {
+    messages.emplace_back(data, data + len);
+  }
+
+  void OnMessageSent(bool acked) { sent.push_back(acked); }
+};
+
+void Link::Run() {
+  while (!air.empty()) {
+    Frame f = air.front();
+    air.pop_front();
+    if (f.ack) {
+      acks++;
+    } else {
+      fragments++;
+    }
+    if (drop(f)) continue;
+    for (Badge *b : badges) {
+      if (b->id == f.from) continue;
+      if (f.ack) {
+        FragmentAckPacket ack;
+        memcpy(&ack, f.bytes.data(), sizeof(ack));
+        b->frag.OnFragmentAck(ack);
+      } else {
+        FragmentPacket packet;
+        memcpy(&packet, f.bytes.data(), f.bytes.size());
+        b->frag.OnFragment(packet, f.bytes.size());
+      }
+    }
+  }
+}
+
+std::vector<uint8_t> Message(size_t len, uint8_t seed) {
+  std::vector<uint8_t> ret(len);
+  for (size_t i = 0; i < len; i++) ret[i] = seed + i * 7;
+  return ret;
+}
+
+// Index of a fragment frame, -1 for an ACK.
+int FragmentIndex(const Frame &f) {
+  if (f.ack) return -1;
+  return f.bytes[FRAGMENT_SENDER_LEN + 1] & kFragmentIndexMask;
+}
+
+void Tick(Link &link, int n) {
+  for (int i = 0; i < n; i++) {
+    for (Badge *b : link.badges) b->frag.Tick();
+    link.Run();
+  }
+}
+
+void TestSizes() {
+  size_t sizes[] = {1, FRAGMENT_DATA_SIZE, FRAGMENT_DATA_SIZE + 1, 100,
+                    FRAGMENT_MAX_MESSAGE};
+  for (size_t len : sizes) {
+    Link link;
+    Badge a(&link, 1), b(&link, 2);
+    std::vector<uint8_t> msg = Message(len, len);
+    CHECK(a.frag.Send(msg.data(), msg.size()));
+    CHECK(a.frag.Busy());
+    link.Run();
+    CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+    CHECK(a.sent == std::vector<bool>({true}));
+    CHECK(!a.frag.Busy());
+    size_t count = (len + FRAGMENT_DATA_SIZE - 1) / FRAGMENT_DATA_SIZE;
+    CHECK(link.fragments == count);
+    CHECK(link.acks == 1);
+  }
+  Link link;
+  Badge a(&link, 1);
+  std::vector<uint8_t> msg = Message(FRAGMENT_MAX_MESSAGE + 1, 0);
+  CHECK(!a.frag.Send(msg.data(), msg.size()));
+  CHECK(!a.frag.Send(msg.data(), 0));
+}
+
+void TestSelectiveRepeat() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  std::vector<uint8_t> msg = Message(FRAGMENT_MAX_MESSAGE, 3);
+  // Fragments 1 and 4 lost the first time.
+  std::vector<int> seen;
+  link.drop = [&](const Frame &f) {
+    int i = FragmentIndex(f);
+    if (i < 0) return false;
+    seen.push_back(i);
+    return seen.size() <= FRAGMENT_MAX_COUNT && (i == 1 || i == 4);
+  };
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+  CHECK(a.sent == std::vector<bool>({true}));
+  // Only the lost ones again, right on the ACK.
+  CHECK(link.fragments == FRAGMENT_MAX_COUNT + 2);
+  CHECK(seen.size() == FRAGMENT_MAX_COUNT + 2 &&
+        seen[FRAGMENT_MAX_COUNT] == 1 && seen[FRAGMENT_MAX_COUNT + 1] == 4);
+}
+
+void TestLastLost() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  std::vector<uint8_t> msg = Message(3 * FRAGMENT_DATA_SIZE, 5);
+  // The one asking for the ACK is lost, the receiver asks on its own.
+  bool dropped = false;
+  link.drop = [&](const Frame &f) {
+    if (FragmentIndex(f) != 2 || dropped) return false;
+    dropped = true;
+    return true;
+  };
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  CHECK(b.messages.empty());
+  Tick(link, FRAGMENT_GAP_TICKS - 1);
+  CHECK(link.acks == 0);
+  Tick(link, 1);
+  CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+  CHECK(a.sent == std::vector<bool>({true}));
+  CHECK(link.fragments == 4);
+}
+
+void TestAckLost() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  std::vector<uint8_t> msg = Message(2 * FRAGMENT_DATA_SIZE, 9);
+  bool dropped = false;
+  link.drop = [&](const Frame &f) {
+    if (!f.ack || dropped) return false;
+    dropped = true;
+    return true;
+  };
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  CHECK(b.messages.size() == 1);
+  Tick(link, FRAGMENT_ACK_TICKS - 1);
+  CHECK(a.sent.empty());
+  // The round again, the receiver acknowledges without a second delivery.
+  Tick(link, 1);
+  CHECK(a.sent == std::vector<bool>({true}));
+  CHECK(b.messages.size() == 1);
+  CHECK(link.fragments == 4);
+
+  // The next message has a new msg_id, not taken for the old one.
+  msg = Message(10, 1);
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  CHECK(b.messages.size() == 2 && b.messages[1] == msg);
+}
+
+void TestGiveUp() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  link.drop = [](const Frame &f) { return !f.ack; };
+  std::vector<uint8_t> msg = Message(40, 2);
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  Tick(link, FRAGMENT_ACK_TICKS * FRAGMENT_RETRIES);
+  CHECK(a.sent.empty());
+  Tick(link, FRAGMENT_ACK_TICKS);
+  CHECK(a.sent == std::vector<bool>({false}));
+  CHECK(link.fragments == 2 * (FRAGMENT_RETRIES + 1));
+  CHECK(!a.frag.Busy());
+  CHECK(b.messages.empty());
+}
+
+void TestTransmitterFull() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  a.room = 2;
+  std::vector<uint8_t> msg = Message(FRAGMENT_MAX_MESSAGE, 4);
+  a.frag.Send(msg.data(), msg.size());
+  CHECK(link.air.size() == 2);
+  // Pump() as each is on the air.
+  while (!link.air.empty()) {
+    link.Run();
+    a.room = 1;
+    a.frag.Pump();
+  }
+  CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+  CHECK(link.fragments == FRAGMENT_MAX_COUNT);
+}
+
+void TestInterleaved() {
+  // Two senders at once, the third badge gets both.
+  Link link;
+  Badge a(&link, 1), b(&link, 2), c(&link, 3);
+  std::vector<uint8_t> ma = Message(80, 1), mb = Message(120, 2);
+  a.room = b.room = 0;
+  a.frag.Send(ma.data(), ma.size());
+  b.frag.Send(mb.data(), mb.size());
+  for (int i = 0; i < 10; i++) {
+    a.room = b.room = 1;
+    a.frag.Pump();
+    b.frag.Pump();
+    link.Run();
+  }
+  CHECK(c.messages.size() == 2);
+  CHECK(a.messages.size() == 1 && a.messages[0] == mb);
+  CHECK(b.messages.size() == 1 && b.messages[0] == ma);
+  CHECK(a.sent == std::vector<bool>({true}));
+  CHECK(b.sent == std::vector<bool>({true}));
+}
+
+void TestBadFragments() {
+  Link link;
+  Badge a(&link, 1), b(&link, 2);
+  FragmentPacket packet = {{9, 9}, 1, 0};
+  // Index past the last, last past the max, short one that isn't the last.
+  packet.index = 2 | (1 << kFragmentLastShift);
+  b.frag.OnFragment(packet, FRAGMENT_HEADER_SIZE + 1);
+  packet.index = 0 | (FRAGMENT_MAX_COUNT << kFragmentLastShift);
+  b.frag.OnFragment(packet, FRAGMENT_HEADER_SIZE + FRAGMENT_DATA_SIZE);
+  packet.index = 0 | (1 << kFragmentLastShift) | kFragmentAckRequest;
+  b.frag.OnFragment(packet, FRAGMENT_HEADER_SIZE + 1);
+  b.frag.OnFragment(packet, FRAGMENT_HEADER_SIZE);
+  CHECK(link.air.empty());
+
+  // A message that never completes is freed, so the slots don't run out.
+  for (uint8_t id = 0; id < 2 * FRAGMENT_REASSEMBLY_SLOTS; id++) {
+    packet.msg_id = id;
+    packet.index = 0 | (1 << kFragmentLastShift);
+    b.frag.OnFragment(packet, FRAGMENT_HEADER_SIZE + FRAGMENT_DATA_SIZE);
+  }
+  Tick(link, FRAGMENT_TIMEOUT_TICKS);
+  std::vector<uint8_t> msg = Message(60, 6);
+  a.frag.Send(msg.data(), msg.size());
+  link.Run();
+  CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+}
+
+void TestNoSender() {
+  // No ID yet, so nothing to send, but it takes messages from anyone, the
+  // sender ID we don't have yet included.
+  Link link;
+  Badge a(&link, 1), b(&link, 2, false);
+  uint8_t zero[FRAGMENT_SENDER_LEN] = {};
+  a.frag.Init(zero, 0);
+  std::vector<uint8_t> msg = Message(50, 7);
+  CHECK(!b.frag.Send(msg.data(), msg.size()));
+  CHECK(link.air.empty());
+  CHECK(a.frag.Send(msg.data(), msg.size()));
+  link.Run();
+  CHECK(b.messages.size() == 1 && b.messages[0] == msg);
+  CHECK(a.sent == std::vector<bool>({true}));
+}
+
+}  // namespace
+
+int main() {
+  TestSizes();
+  TestSelectiveRepeat();
+  TestLastLost();
+  TestAckLost();
+  TestGiveUp();
+  TestTransmitterFull();
+  TestInterleaved();
+  TestBadFragments();
+  TestNoSender();
+  return hitcon::test::TestResult("Fragmenter");
+}
+
+#endif  // HITCON_TEST_MODE
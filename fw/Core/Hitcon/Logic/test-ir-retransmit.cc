@@ -0,0 +1,190 @@
+#ifdef HITCON_TEST_MODE
+
+// RetransmitQueue against a Port whose hash service and transmitter the test
+// drives.
+
+#include <Logic/IrRetransmit.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+class Badge {
+ public:
+  Badge() : retx(this) {}
+
+  RetransmitQueue<Badge> retx;
+  // Tag of the packet being hashed, -1 for none.
+  int hashing = -1;
+  bool hash_busy = false;
+  size_t room = 100;
+  uint32_t random = 0;
+  // Tags in the order sent.
+  std::vector<int> sent;
+  size_t acked = 0;
+
+  // Port.
+  bool StartHash(const uint8_t *data, size_t len) {
+    if (hash_busy || hashing != -1) return false;
+    hashing = data[0];
+    return true;
+  }
+  bool CanSend() { return room > 0; }
+  bool Send(uint8_t *data, size_t len) {
+    if (!room) return false;
+    room--;
+    sent.push_back(data[0]);
+    return true;
+  }
+  void OnAcknowledgeTag(AckTag tag) { acked++; }
+  uint32_t Random() { return random; }
+
+  // Finishes the hash in progress, the digest is the tag repeated.
+  void FinishHash() {
+    uint8_t digest[PACKET_HASH_LEN];
+    memset(digest, hashing, sizeof(digest));
+    hashing = -1;
+    retx.OnHashResult(digest);
+  }
+
+  bool Push(uint8_t tag, uint8_t retries = 3) {
+    uint8_t data[4] = {tag, 1, 2, 3};
+    return retx.Push(data, sizeof(data), retries, AckTag::ACK_TAG_NONE);
+  }
+
+  void Ack(uint8_t tag) {
+    uint8_t hash[PACKET_HASH_LEN];
+    memset(hash, tag, sizeof(hash));
+    retx.OnAcknowledge(hash);
+  }
+
+  void Maintain(int n) {
+    for (int i = 0; i < n; i++) retx.Maintain();
+  }
+};
+
+void TestSendsWithoutMaintain() {
+  Badge b;
+  CHECK(b.Push(1));
+  // Hashed right away, sent as the hash is back.
+  CHECK(b.hashing == 1);
+  b.FinishHash();
+  CHECK(b.sent == std::vector<int>({1}));
+  b.Ack(1);
+  CHECK(b.acked == 1);
+  b.Maintain(2 * RETX_RETRY_TICKS);
+  CHECK(b.sent.size() == 1);
+}
+
+void TestSlots() {
+  Badge b;
+  for (int i = 0; i < RETX_QUEUE_SIZE; i++) CHECK(b.Push(i));
+  CHECK(!b.Push(100));
+  // One hash at a time, in the order pushed.
+  for (int i = 0; i < RETX_QUEUE_SIZE; i++) {
+    CHECK(b.hashing == i);
+    b.FinishHash();
+    // Port::Pump() once the service is free.
+    b.retx.Pump();
+  }
+  CHECK(b.sent.size() == RETX_QUEUE_SIZE);
+  for (int i = 0; i < RETX_QUEUE_SIZE; i++) CHECK(b.sent[i] == i);
+  b.Ack(7);
+  CHECK(b.Push(100));
+}
+
+void TestBusy() {
+  Badge b;
+  b.hash_busy = true;
+  b.room = 0;
+  b.Push(1);
+  b.Push(2);
+  CHECK(b.hashing == -1);
+  b.hash_busy = false;
+  b.retx.Pump();
+  b.FinishHash();
+  b.retx.Pump();
+  b.FinishHash();
+  CHECK(b.sent.empty());
+  // Both go once the transmitter has room, oldest first.
+  b.room = 1;
+  b.retx.Pump();
+  CHECK(b.sent == std::vector<int>({1}));
+  b.room = 1;
+  b.retx.Pump();
+  CHECK(b.sent == std::vector<int>({1, 2}));
+  // An ack while waiting for the transmitter frees the slot too.
+  b.Push(3);
+  b.FinishHash();
+  b.Ack(3);
+  b.room = 1;
+  b.retx.Pump();
+  CHECK(b.sent == std::vector<int>({1, 2}));
+  CHECK(b.acked == 1);
+}
+
+void TestRetryOrder() {
+  Badge b;
+  // 1 is sent first but times out last.
+  b.random = 0;
+  b.Push(1);
+  b.FinishHash();
+  b.random = 2 * RETX_RETRY_JITTER - 1;
+  b.Push(2);
+  b.FinishHash();
+  CHECK(b.sent == std::vector<int>({1, 2}));
+  int first = RETX_RETRY_TICKS - RETX_RETRY_JITTER + 1;
+  int second = RETX_RETRY_TICKS + RETX_RETRY_JITTER;
+  b.Maintain(first - 1);
+  CHECK(b.sent.size() == 2);
+  b.Maintain(1);
+  CHECK(b.sent == std::vector<int>({1, 2, 2}));
+  b.Maintain(second - first - 1);
+  CHECK(b.sent.size() == 3);
+  b.Maintain(1);
+  CHECK(b.sent == std::vector<int>({1, 2, 2, 1}));
+}
+
+void TestRetriesRunOut() {
+  Badge b;
+  b.Push(1, 2);
+  b.FinishHash();
+  b.Maintain(3 * (RETX_RETRY_TICKS + RETX_RETRY_JITTER));
+  CHECK(b.sent == std::vector<int>({1, 1, 1}));
+  // The slot is free again.
+  for (int i = 0; i < RETX_QUEUE_SIZE; i++) CHECK(b.Push(10 + i));
+}
+
+void TestMultiAck() {
+  Badge b;
+  for (int i = 1; i <= 3; i++) {
+    b.Push(i);
+    b.FinishHash();
+    b.retx.Pump();
+  }
+  uint8_t hashes[2 * MULTI_ACK_HASH_LEN];
+  memset(hashes, 1, MULTI_ACK_HASH_LEN);
+  memset(hashes + MULTI_ACK_HASH_LEN, 3, MULTI_ACK_HASH_LEN);
+  b.retx.OnAcknowledgeMulti(hashes, 2);
+  CHECK(b.acked == 2);
+  b.Maintain(RETX_RETRY_TICKS + RETX_RETRY_JITTER);
+  CHECK(b.sent == std::vector<int>({1, 2, 3, 2}));
+}
+
+}  // namespace
+
+int main() {
+  TestSendsWithoutMaintain();
+  TestSlots();
+  TestBusy();
+  TestRetryOrder();
+  TestRetriesRunOut();
+  TestMultiAck();
+  return hitcon::test::TestResult("RetransmitQueue");
+}
+
+#endif  // HITCON_TEST_MODE
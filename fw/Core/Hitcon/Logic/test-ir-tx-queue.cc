@@ -0,0 +1,144 @@
+#ifdef HITCON_TEST_MODE
+
+// IrTxQueue, and IrMac chaining the frames it hands out.
+
+#include <Logic/IrMac.h>
+#include <Logic/IrTxQueue.h>
+#include <Logic/test-check.h>
+#include <stdio.h>
+
+#include <vector>
+
+using namespace hitcon::ir;
+
+namespace {
+
+std::vector<int> done;
+
+void OnDone(void *arg, void *unused) {
+  done.push_back(static_cast<int>(reinterpret_cast<intptr_t>(arg)));
+}
+
+bool Push(IrTxQueue &queue, uint8_t tag, TxPriority priority) {
+  uint8_t data[3] = {0, 1, tag};
+  void *arg = reinterpret_cast<void *>(static_cast<intptr_t>(tag));
+  return queue.Push(data, sizeof(data), priority, false, IrPhy::kNormal,
+                    &OnDone, arg);
+}
+
+// Tag of the packet Pop() gives, -1 for none.
+int PopTag(IrTxQueue &queue) {
+  IrPacket *packet = queue.Pop();
+  if (!packet) return -1;
+  // Size byte, then the payload.
+  return packet->data_[3];
+}
+
+void TestOrder() {
+  IrTxQueue queue;
+  CHECK(queue.Pop() == nullptr);
+  CHECK(Push(queue, 1, TxPriority::kNormal));
+  CHECK(Push(queue, 2, TxPriority::kNormal));
+  CHECK(Push(queue, 3, TxPriority::kHigh));
+  CHECK(Push(queue, 4, TxPriority::kNormal));
+  CHECK(!queue.HasRoom());
+  CHECK(!Push(queue, 5, TxPriority::kHigh));
+
+  int order[] = {3, 1, 2, 4};
+  for (int tag : order) {
+    CHECK(PopTag(queue) == tag);
+    // Nothing else while it's on the air.
+    CHECK(queue.Pop() == nullptr);
+    queue.OnSent();
+  }
+  CHECK(queue.Pop() == nullptr);
+}
+
+void TestDone() {
+  IrTxQueue queue;
+  done.clear();
+  for (int tag = 1; tag <= 4; tag++) Push(queue, tag, TxPriority::kNormal);
+  CHECK(PopTag(queue) == 1);
+  queue.OnSent();
+  // The slot is held until its callback ran.
+  CHECK(!queue.HasRoom());
+  CHECK(done.empty());
+  queue.DeliverDone();
+  CHECK(done == std::vector<int>({1}));
+  CHECK(queue.HasRoom());
+
+  // FIFO holds across the reused slot.
+  CHECK(Push(queue, 5, TxPriority::kNormal));
+  int order[] = {2, 3, 4, 5};
+  for (int tag : order) {
+    CHECK(PopTag(queue) == tag);
+    queue.OnSent();
+  }
+  queue.DeliverDone();
+  CHECK(done.size() == 5);
+}
+
+void TestSequenceWraps() {
+  IrTxQueue queue;
+  for (int i = 0; i < 300; i++) {
+    CHECK(Push(queue, i, TxPriority::kNormal));
+    CHECK(Push(queue, i + 1, TxPriority::kNormal));
+    CHECK(PopTag(queue) == static_cast<uint8_t>(i));
+    queue.OnSent();
+    CHECK(PopTag(queue) == static_cast<uint8_t>(i + 1));
+    queue.OnSent();
+    queue.DeliverDone();
+  }
+}
+
+// Releases mac, RX quiet long enough for any window.
+void Release(IrMac &mac) {
+  mac.Request();
+  mac.OnRxSilence(1000);
+  CHECK(mac.TryRelease());
+  CHECK(mac.Sending());
+}
+
+void TestChain() {
+  IrMac mac;
+  Release(mac);
+  // Up to 4 frames on one release.
+  for (int i = 0; i < 3; i++) {
+    mac.Done();
+    CHECK(mac.Chain());
+    CHECK(mac.Sending());
+  }
+  mac.Done();
+  CHECK(!mac.Chain());
+  CHECK(mac.Idle());
+
+  // The count starts over on the next release.
+  Release(mac);
+  mac.Done();
+  CHECK(mac.Chain());
+
+  // Not once anything was heard after Done().
+  mac.Done();
+  mac.OnRxByte(0);
+  CHECK(!mac.Chain());
+  CHECK(mac.Idle());
+
+  // Nor after falling back to Request().
+  Release(mac);
+  mac.Done();
+  mac.Request();
+  CHECK(!mac.Chain());
+  CHECK(!mac.Sending());
+}
+
+}  // namespace
+
+int main() {
+  TestOrder();
+  TestDone();
+  TestSequenceWraps();
+  TestChain();
+  return hitcon::test::TestResult("IrTxQueue");
+}
+
+#endif  // HITCON_TEST_MODE
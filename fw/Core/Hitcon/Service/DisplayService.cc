@@ -37,7 +37,8 @@ void DisplayTransferHalfComplete(DMA_HandleTypeDef* hdma) {
     tmp_request_cb_param.callback =
         g_display_service.request_frame_callback_arg1;
     tmp_request_cb_param.buf_index = 0;
-    scheduler.Queue(&(g_display_service.task), &tmp_request_cb_param);
+    g_display_service.isr_queue.Push(&(g_display_service.task),
+                                     &tmp_request_cb_param);
   }
 }
 
@@ -46,11 +47,16 @@ void DisplayTransferComplete(DMA_HandleTypeDef* hdma) {
     tmp_request_cb_param.callback =
         g_display_service.request_frame_callback_arg1;
     tmp_request_cb_param.buf_index = 1;
-    scheduler.Queue(&(g_display_service.task), &tmp_request_cb_param);
+    g_display_service.isr_queue.Push(&(g_display_service.task),
+                                     &tmp_request_cb_param);
   }
 }
 
 void DisplayService::Init() {
+  // Each DMA half is 32 transfers at 1.6kHz (20ms), leave the task time to
+  // fill the next frames.
+  task.SetDeadline(10);
+  scheduler.AddIsrQueue(&isr_queue);
   tmp_request_cb_param.callback = request_frame_callback_arg1;
   tmp_request_cb_param.buf_index = 0;
   scheduler.Queue(&task, &tmp_request_cb_param);
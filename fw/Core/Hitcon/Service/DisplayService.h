@@ -3,6 +3,7 @@
 
 #include <Logic/Display/display.h>
 #include <Service/DisplayInfo.h>
+#include <Service/Sched/IsrQueue.h>
 #include <Service/Sched/Task.h>
 #include <Util/callback.h>
 #include <stddef.h>
@@ -41,6 +42,8 @@ class DisplayService {
 
   void* request_frame_callback_arg1;
   Task task;
+  // Used by the DMA callbacks to queue task without masking interrupts.
+  IsrQueue isr_queue;
 
  private:
   void RequestFrameWrapper(request_cb_param* arg);
@@ -2,6 +2,7 @@
 #define HASH_SERVICE_H
 
 #include <Logic/keccak.h>
+#include <Service/Sched/Coroutine.h>
 #include <Service/Sched/Scheduler.h>
 #include <Util/callback.h>
 #include <stddef.h>
@@ -15,16 +16,6 @@ constexpr size_t SHA3_BIT_SIZE = 256;
 
 namespace internal {
 
-struct HashStatus {
-  size_t progress;
-  int round;
-  enum state { kUpdateState, kFinalizeState, kDoneState } state;
-
-  HashStatus();
-  void Init();
-  void NewState(enum state state);
-};
-
 struct ServiceContext {
   uint8_t const *message;
   size_t len;
@@ -62,18 +53,13 @@ class HashService {
   HashService();
 
  private:
-  service::sched::PeriodicTask hashTask;
+  service::sched::CoTask hashTask;
 
   internal::ServiceContext serviceContext;
-  internal::HashStatus status;
   sha3_context sha3Context;
   HashResult result;
 
-  void doHash(void *unused);
-
-  void doHashUpdate();
-  void doHashFinalize();
-  void doHashDone();
+  service::sched::Coroutine doHash();
 };
 
 extern HashService g_hash_service;
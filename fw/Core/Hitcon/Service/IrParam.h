@@ -18,19 +18,45 @@ constexpr size_t DECODE_SAMPLE_RATIO = 4;
 // and 1s are both less than this value, the bit is considered as invalid.
 constexpr size_t DECODE_SAMPLE_RATIO_THRESHOLD = 3;
 
-// Half circular size of the tx dma buffer, this is the number of uint16_t per
-// interrupt (half/full).
-constexpr size_t IR_SERVICE_TX_SIZE = 128;
-// Half circular size of the rx dma buffer, this is the number of uint16_t per
+// Each packet goes out on one of these, told apart by its header.
+enum class IrPhy : uint8_t {
+  // PULSE_PER_DATA_BIT, what every badge decodes.
+  kNormal = 0,
+  // PULSE_PER_DATA_BIT_FAST, twice the data rate. Older firmware doesn't see
+  // IR_PACKET_HEADER_FAST as a header and skips the packet.
+  kFast = 1,
+};
+
+// Half circular size of the rx dma buffer, this is the number of samples per
 // interrupt (half/full).
 constexpr size_t IR_SERVICE_RX_SIZE = 64;
-constexpr int16_t IR_PWM_TIM_CCR = 16;
-
-constexpr size_t IR_SERVICE_RX_ON_BUFFER_SIZE = 32;
+// Bit of GPIOA IDR the receiver is on, IrRx_Pin. The RX DMA keeps the low byte
+// of IDR for each sample, so it has to be in there.
+constexpr unsigned IR_RX_IDR_BIT = 0;
+static_assert(IR_RX_IDR_BIT < 8);
+// Scheduler deadlines in ticks for the DMA tasks, they need to start before
+// the DMA gets back to the half they handle. RX half takes 64 samples at 9.5kHz
+// (6.7ms). One tick is lost to tick granularity.
+constexpr unsigned IR_SERVICE_RX_DEADLINE = 5;
+
+// Each TX DMA entry is a TIM3 CCR3 value held for IR_TX_PULSE_PER_ENTRY
+// pulses at 38kHz. The TX DMA runs on TIM2 update, which comes once per RX
+// sample. IR_RX_CAPTURE has TIM2 free running, so there it runs on TIM3 CC3
+// once per pulse.
+// IR_SERVICE_TX_SIZE is the half circular size of the tx dma buffer, this is
+// the number of uint16_t per interrupt (half/full). The TX half takes 256
+// pulses (6.7ms), or 128 pulses (3.4ms) with IR_RX_CAPTURE.
+#ifndef IR_RX_CAPTURE
+constexpr size_t IR_TX_PULSE_PER_ENTRY = 4;
+constexpr size_t IR_SERVICE_TX_SIZE = 64;
+constexpr unsigned IR_SERVICE_TX_DEADLINE = 5;
+#else
+constexpr size_t IR_TX_PULSE_PER_ENTRY = 1;
+constexpr size_t IR_SERVICE_TX_SIZE = 128;
+constexpr unsigned IR_SERVICE_TX_DEADLINE = 2;
+#endif  // IR_RX_CAPTURE
 
-// How many rx buffer is processed per task run in IrLogic?
-constexpr size_t IR_SERVICE_RX_BUFFER_PER_RUN = 4;
-static_assert(IR_SERVICE_RX_ON_BUFFER_SIZE % IR_SERVICE_RX_BUFFER_PER_RUN == 0);
+constexpr int16_t IR_PWM_TIM_CCR = 16;
 
 // Two elements represents a data bit, see PULSE_PER_HEADER_BIT.
 constexpr uint8_t IR_PACKET_HEADER[] = {
@@ -44,28 +70,81 @@ constexpr uint8_t IR_PACKET_HEADER[] = {
 constexpr size_t IR_PACKET_HEADER_PACKED = 0b111'111'00000'00000'111'111;
 // last bit is don't care
 constexpr size_t IR_PACKET_HEADER_MASK = 0b111'110'01111'11110'011'110;
+
+// Header of an IrPhy::kFast packet, one element is a bit at its rate.
+// The gaps are too short for IR_PACKET_HEADER_MASK and the lead in is too long
+// for either mask, so neither header is taken for the other, nor found early
+// behind a frame that ends in 1s.
+constexpr uint8_t IR_PACKET_HEADER_FAST[] = {
+    0, 0, 0, 0, 0, 0, 0,  // Lead in.
+    1, 1, 1,              // 3x bit time of 1.
+    0, 0, 0,              // 3x bit time of 0.
+    1, 1, 1               // 3x bit time of 1.
+};
+constexpr size_t IR_PACKET_HEADER_FAST_PACKED = 0b111'111'000'000'111'111;
+constexpr size_t IR_PACKET_HEADER_FAST_MASK = 0b111'110'011'110'011'110;
 constexpr size_t IR_CHKSUM_SZ = 8;
 
+// A FEC packet has IR_FEC_MARK before the size byte, and IR_FEC_PARITY_BYTES
+// of Reed-Solomon parity after the checksum, counted in the size, see
+// IrFec.h. Older firmware takes the mark for a size byte and drops the
+// packet as too large. A single mark value keeps noise from starting FEC
+// packets more often than plain ones.
+constexpr uint8_t IR_FEC_MARK = 0xA5;
+constexpr size_t IR_FEC_PARITY_BYTES = 2;
+// Send with FEC, the receiver takes both. Off until the badges in the field and
+// the base stations run firmware that takes IR_FEC_MARK, they drop every FEC
+// packet.
+constexpr bool IR_TX_FEC = false;
+
 constexpr size_t PULSE_PER_DATA_BIT = 16;
 constexpr size_t PULSE_PER_HEADER_BIT = PULSE_PER_DATA_BIT / 2;
 
+// IrPhy::kFast, the same RX sampling with DECODE_SAMPLE_RATIO_FAST samples per
+// bit. Both have to agree, so a bad sample makes the bit invalid instead of
+// flipping it and FEC gets an erasure.
+constexpr size_t PULSE_PER_DATA_BIT_FAST = 8;
+constexpr size_t DECODE_SAMPLE_RATIO_FAST = 2;
+static_assert(PULSE_PER_DATA_BIT_FAST / DECODE_SAMPLE_RATIO_FAST ==
+              PULSE_PER_DATA_BIT / DECODE_SAMPLE_RATIO);
+
+// A badge sends on the IrPhy of the last packet it heard, so a room goes fast
+// once someone sends on IrPhy::kFast, and back as soon as a badge that only
+// has IrPhy::kNormal speaks. IR_TX_PHY is where it starts, and what it falls
+// back to after IR_PHY_FAST_HOLD_MS without hearing IrPhy::kFast. Building
+// with IrPhy::kFast makes the badge always send on it.
+constexpr IrPhy IR_TX_PHY = IrPhy::kNormal;
+constexpr unsigned IR_PHY_FAST_HOLD_MS = 10000;
+
 // Number of elements in IR_PACKET_HEADER.
 constexpr size_t IR_PACKET_HEADER_SIZE =
     sizeof(IR_PACKET_HEADER) / sizeof(IR_PACKET_HEADER[0]);
-// How many elements of IR_PACKET_HEADER do we send out per DMA population run?
-constexpr size_t IR_PACKET_PER_RUN = (IR_SERVICE_TX_SIZE) / 8;
-constexpr size_t IR_PACKET_RUN_COUNT =
-    IR_PACKET_HEADER_SIZE / IR_PACKET_PER_RUN;
-
-static_assert((IR_SERVICE_TX_SIZE) % 8 == 0);
-static_assert((IR_PACKET_HEADER_SIZE * 8) % (IR_SERVICE_TX_SIZE) == 0);
+constexpr size_t IR_PACKET_HEADER_FAST_SIZE =
+    sizeof(IR_PACKET_HEADER_FAST) / sizeof(IR_PACKET_HEADER_FAST[0]);
+
+// TX DMA entries per header element and per data bit.
+constexpr size_t IR_TX_ENTRY_PER_HEADER_BIT =
+    PULSE_PER_HEADER_BIT / IR_TX_PULSE_PER_ENTRY;
+constexpr size_t IR_TX_ENTRY_PER_DATA_BIT =
+    PULSE_PER_DATA_BIT / IR_TX_PULSE_PER_ENTRY;
+constexpr size_t IR_TX_ENTRY_PER_DATA_BIT_FAST =
+    PULSE_PER_DATA_BIT_FAST / IR_TX_PULSE_PER_ENTRY;
+static_assert(PULSE_PER_DATA_BIT_FAST % IR_TX_PULSE_PER_ENTRY == 0);
+static_assert(PULSE_PER_HEADER_BIT % IR_TX_PULSE_PER_ENTRY == 0);
+
+// Bytes of 8 samples packed from each RX DMA half.
+constexpr size_t IR_BYTE_PER_RUN = IR_SERVICE_RX_SIZE / 8;
 
-constexpr size_t IR_BITS_PER_TX_RUN = (IR_SERVICE_TX_SIZE) / PULSE_PER_DATA_BIT;
-static_assert((IR_SERVICE_TX_SIZE / 2) % PULSE_PER_DATA_BIT == 0);
+// Input capture receiver, build with IR_RX_CAPTURE to use it instead of GPIO
+// sampling. TIM2 counts TIM3 updates, one tick per 38kHz pulse.
+constexpr size_t IR_TICKS_PER_SAMPLE = PULSE_PER_DATA_BIT / DECODE_SAMPLE_RATIO;
+// Edges buffered between two runs of the RX task. A run is queued once half
+// of it is used, the other half holds at least 8 data bits (3.4ms).
+constexpr size_t IR_RX_EDGE_RING_SIZE = 16;
+constexpr unsigned IR_SERVICE_RX_CAPTURE_DEADLINE = 2;
 
-constexpr size_t IR_BYTE_PER_RUN = IR_SERVICE_RX_SIZE / 8;
-// An integer number of run is needed to fulfill the OnBufferRecv().
-static_assert(IR_SERVICE_RX_ON_BUFFER_SIZE % IR_BYTE_PER_RUN == 0);
+// IrService routine period in ms, runs IrMac::Routine().
+constexpr unsigned IR_MAC_ROUTINE_PERIOD = 22;
 
 // How many bytes in the rx buffer to be all zero for us to consider the period
 // as quiet?
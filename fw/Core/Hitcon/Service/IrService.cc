@@ -1,3 +1,4 @@
+#include <Logic/IrStats.h>
 #include <Logic/RandomPool.h>
 #include <Service/IrService.h>
 #include <Service/Suspender.h>
@@ -20,109 +21,194 @@ IrService irService;
 IrService::IrService()
     : dma_tx_populate_task(
           100, (task_callback_t)&IrService::PopulateTxDmaBuffer, this),
+#ifndef IR_RX_CAPTURE
       dma_rx_pull_task(150, (task_callback_t)&IrService::PullRxDmaBuffer, this),
-      routine_task(600, (callback_t)&IrService::Routine, this, 22),
-      on_rx_callback_runner(500, (callback_t)&IrService::OnBufferRecvWrapper,
-                            this),
-      rx_buffer_base(0), rx_on_buffer_callback_finished(true), rx_quiet_cnt(0),
-      rx_required_quiet_period(500), rx_ctr_since_release(100000),
-      tx_packet_cnt(0) {}
+#else
+      dma_rx_pull_task(150, (task_callback_t)&IrService::PullRxEdges, this),
+#endif  // IR_RX_CAPTURE
+      tx_pos(0), tx_done_callback(nullptr), tx_done_callback_arg(nullptr),
+      routine_task(600, (callback_t)&IrService::Routine, this,
+                   IR_MAC_ROUTINE_PERIOD),
+      rx_decoder(nullptr) {}
 
+#ifndef IR_RX_CAPTURE
 void ReceiveDmaHalfCplt(DMA_HandleTypeDef *hdma) {
   if (!g_suspender.IsSuspended()) {
-    scheduler.Queue(&irService.dma_rx_pull_task, reinterpret_cast<void *>(0));
+    irService.rx_isr_queue.Push(&irService.dma_rx_pull_task,
+                                reinterpret_cast<void *>(0));
   }
 }
 
 void ReceiveDmaCplt(DMA_HandleTypeDef *hdma) {
   if (!g_suspender.IsSuspended()) {
-    scheduler.Queue(&irService.dma_rx_pull_task, reinterpret_cast<void *>(1));
+    irService.rx_isr_queue.Push(&irService.dma_rx_pull_task,
+                                reinterpret_cast<void *>(1));
   }
 }
+#endif  // IR_RX_CAPTURE
 
 void TransmitDmaHalfCplt(DMA_HandleTypeDef *hdma) {
   if (!g_suspender.IsSuspended()) {
-    scheduler.Queue(&irService.dma_tx_populate_task,
-                    reinterpret_cast<void *>(0));
+    irService.tx_isr_queue.Push(&irService.dma_tx_populate_task,
+                                reinterpret_cast<void *>(0));
   }
   //  irService.PopulateTxDmaBuffer(reinterpret_cast<void *>(1));
 }
 
 void TransmitDmaCplt(DMA_HandleTypeDef *hdma) {
   if (!g_suspender.IsSuspended()) {
-    scheduler.Queue(&irService.dma_tx_populate_task,
-                    reinterpret_cast<void *>(1));
+    irService.tx_isr_queue.Push(&irService.dma_tx_populate_task,
+                                reinterpret_cast<void *>(1));
   }
   //  irService.PopulateTxDmaBuffer(reinterpret_cast<void *>(1));
 }
 
+#ifndef IR_RX_CAPTURE
 void IrService::PullRxDmaBuffer(void *ptr_side) {
   int side = reinterpret_cast<intptr_t>(ptr_side);
 
-  size_t k = 0;
-  size_t dma_base = (-side) & static_cast<int>(IR_SERVICE_RX_SIZE);
-  for (size_t i = 0; i < IR_BYTE_PER_RUN; i++) {
-    rx_buffer[rx_buffer_base] = 0;
-    for (size_t j = 0; j < 8; j++, k++) {
-      bool cbit = !static_cast<bool>(rx_dma_buffer[dma_base + k] & IrRx_Pin);
-      rx_buffer[rx_buffer_base] |= (-static_cast<int8_t>(cbit)) & (1 << j);
-    }
-    if (rx_buffer[rx_buffer_base])
-      rx_quiet_cnt = 0;
-    else
-      rx_quiet_cnt++;
-
-    rx_buffer_base++;
-  }
-  rx_ctr_since_release++;
-  if (rx_ctr_since_release == 1) {
-    if ((rx_buffer[38] & 0x0F0) != 0 || (rx_buffer[39] & 0x0F) != 0) {
-      // Abort transmission.
-      tx_state = 0x02000000;
-    }
+  static_assert(IR_SERVICE_RX_SIZE == IR_BYTE_PER_RUN * 8);
+  static_assert(IrRx_Pin == 1 << IR_RX_IDR_BIT);
+  const uint8_t *samples =
+      &rx_dma_buffer[(-side) & static_cast<int>(IR_SERVICE_RX_SIZE)];
+  bool was_in_packet = rx_decoder && rx_decoder->InPacket();
+  for (size_t i = 0; i < IR_BYTE_PER_RUN; i++, samples += 8) {
+    uint8_t byte = PackRxSamples(samples);
+    mac.OnRxByte(byte);
+
+    if (rx_decoder) rx_decoder->Push(byte);
   }
 
-  rx_buffer_base = rx_buffer_base % (IR_SERVICE_RX_ON_BUFFER_SIZE * 2);
-  if (rx_buffer_base % IR_SERVICE_RX_ON_BUFFER_SIZE == 0) {
-    my_assert(rx_on_buffer_callback_finished);
-    // Trigger the callback.
+  // Hold off suspend while a packet is coming in.
+  bool in_packet = rx_decoder && rx_decoder->InPacket();
+  if (!was_in_packet && in_packet) {
+    g_suspender.IncBlocker();
+  } else if (was_in_packet && !in_packet) {
+    g_suspender.DecBlocker();
+  }
 
-    // Are we sending the second half to the callback?
-    bool is_second = !(rx_buffer_base / IR_SERVICE_RX_ON_BUFFER_SIZE);
+  if (mac.TryRelease()) tx_pos = 0;
+}
+#else
+extern "C" void TIM2_IRQHandler(void) { irService.OnRxEdge(); }
 
-    if (!is_second && tx_state >> 24 == 0x01 &&
-        rx_quiet_cnt > rx_required_quiet_period) {
-      tx_state = 0x03000000;
-      rx_ctr_since_release = 0;
-    }
+void IrService::OnRxEdge() {
+  TIM_TypeDef *tim = htim2.Instance;
+  if (!(tim->SR & TIM_SR_CC1IF)) return;
+  // Reading CCR1 clears CC1IF.
+  uint16_t tick = tim->CCR1;
+  // Read the line instead of trusting the edge, so a pulse shorter than our
+  // latency can't leave us waiting for the wrong edge.
+  uint8_t level = !(GPIOA->IDR & IrRx_Pin);
+  if (level) {
+    tim->CCER &= ~TIM_CCER_CC1P;
+  } else {
+    tim->CCER |= TIM_CCER_CC1P;
+  }
+
+  static_assert(IR_RX_EDGE_RING_SIZE <= 8 * sizeof(rx_edge_levels));
+  uint8_t head = rx_edge_head;
+  uint8_t used = head - rx_edge_tail;
+  if (used < IR_RX_EDGE_RING_SIZE) {
+    uint8_t slot = head % IR_RX_EDGE_RING_SIZE;
+    rx_edges[slot] = tick;
+    rx_edge_levels = (rx_edge_levels & ~(1u << slot)) | (level << slot);
+    rx_edge_head = head + 1;
+    used++;
+  }
+  if (used >= IR_RX_EDGE_RING_SIZE / 2 && !rx_edge_pull_queued &&
+      !g_suspender.IsSuspended()) {
+    rx_edge_pull_queued = true;
+    rx_isr_queue.Push(&dma_rx_pull_task, nullptr);
+  }
+}
+
+void IrService::PullRxEdges(void *unused) {
+  rx_edge_pull_queued = false;
+
+  // Everything captured before now is in the ring unless its interrupt is
+  // still pending, then we stop at the last edge in the ring.
+  __disable_irq();
+  uint16_t now = htim2.Instance->CNT;
+  uint8_t head = rx_edge_head;
+  bool edge_pending = htim2.Instance->SR & TIM_SR_CC1IF;
+  __enable_irq();
+
+  bool was_in_packet = rx_decoder && rx_decoder->InPacket();
+  for (; rx_edge_tail != head; rx_edge_tail++) {
+    uint8_t slot = rx_edge_tail % IR_RX_EDGE_RING_SIZE;
+    rx_sampler.Edge(rx_edges[slot], (rx_edge_levels >> slot) & 1, this);
+  }
+  if (!edge_pending) rx_sampler.Advance(now, this);
 
-    // Compute the buffer.
-    uint8_t *buffer_ptr = &rx_buffer[(-static_cast<size_t>(is_second)) &
-                                     IR_SERVICE_RX_ON_BUFFER_SIZE];
-    rx_on_buffer_callback_finished = false;
-    scheduler.Queue(&on_rx_callback_runner, buffer_ptr);
+  // Hold off suspend while a packet is coming in.
+  bool in_packet = rx_decoder && rx_decoder->InPacket();
+  if (!was_in_packet && in_packet) {
+    g_suspender.IncBlocker();
+  } else if (was_in_packet && !in_packet) {
+    g_suspender.DecBlocker();
   }
+
+  if (mac.TryRelease()) tx_pos = 0;
+}
+
+void IrService::OnRxByte(uint8_t byte) {
+  mac.OnRxByte(byte);
+  if (rx_decoder) rx_decoder->Push(byte);
 }
 
-void IrService::OnBufferRecvWrapper(void *arg2) {
-  if (on_rx_buffer_cb) on_rx_buffer_cb(on_rx_buffer_arg, arg2);
-  rx_on_buffer_callback_finished = true;
+void IrService::OnRxSilence(size_t bytes) {
+  mac.OnRxSilence(bytes);
+  if (rx_decoder) rx_decoder->PushSilence(bytes);
 }
+#endif  // IR_RX_CAPTURE
+
+int IrService::GetLoadFactor() { return mac.LoadFactor(); }
 
 void IrService::Init() {
+  dma_tx_populate_task.SetDeadline(IR_SERVICE_TX_DEADLINE);
+  scheduler.AddIsrQueue(&rx_isr_queue);
+  scheduler.AddIsrQueue(&tx_isr_queue);
+#ifndef IR_RX_CAPTURE
+  dma_rx_pull_task.SetDeadline(IR_SERVICE_RX_DEADLINE);
   hdma_tim2_ch3.XferHalfCpltCallback = &ReceiveDmaHalfCplt;
   hdma_tim2_ch3.XferCpltCallback = &ReceiveDmaCplt;
+#else
+  dma_rx_pull_task.SetDeadline(IR_SERVICE_RX_CAPTURE_DEADLINE);
+#endif  // IR_RX_CAPTURE
 
   hdma_tim3_ch3.XferCpltCallback = &TransmitDmaCplt;
   hdma_tim3_ch3.XferHalfCpltCallback = &TransmitDmaHalfCplt;
+#ifndef IR_RX_CAPTURE
   __HAL_TIM_ENABLE_DMA(&htim2, TIM_DMA_CC3);
   HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_3);
+#else
+  // Count the whole 16 bits, IrEdgeSampler wraps with it.
+  __HAL_TIM_SET_AUTORELOAD(&htim2, 0xFFFF);
+  TIM_IC_InitTypeDef ic_config = {};
+  // Idle line is high, wait for the carrier first.
+  ic_config.ICPolarity = TIM_ICPOLARITY_FALLING;
+  ic_config.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  ic_config.ICPrescaler = TIM_ICPSC_DIV1;
+  ic_config.ICFilter = 3;
+  HAL_TIM_IC_ConfigChannel(&htim2, &ic_config, TIM_CHANNEL_1);
+  HAL_NVIC_SetPriority(TIM2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(TIM2_IRQn);
+  HAL_TIM_IC_Start_IT(&htim2, TIM_CHANNEL_1);
+#endif  // IR_RX_CAPTURE
   LL_GPIO_AF_RemapPartial2_TIM2();
+#ifndef IR_RX_CAPTURE
+  // TIM2_UP shares DMA1 CH2 with TIM3_CH3, so hdma_tim3_ch3 serves either.
+  __HAL_TIM_ENABLE_DMA(&htim2, TIM_DMA_UPDATE);
+#else
   __HAL_TIM_ENABLE_DMA(&htim3, TIM_DMA_CC3);
+#endif  // IR_RX_CAPTURE
   HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_3);
+#ifndef IR_RX_CAPTURE
   HAL_DMA_Start_IT(&hdma_tim2_ch3, reinterpret_cast<uint32_t>(&GPIOA->IDR),
                    reinterpret_cast<uint32_t>(rx_dma_buffer),
                    IR_SERVICE_RX_SIZE * 2);
+#endif  // IR_RX_CAPTURE
   HAL_DMA_Start_IT(&hdma_tim3_ch3, reinterpret_cast<uint32_t>(tx_dma_buffer),
                    reinterpret_cast<uint32_t>(&(htim3.Instance->CCR3)),
                    IR_SERVICE_TX_SIZE * 2);
@@ -130,10 +216,11 @@ void IrService::Init() {
   scheduler.EnablePeriodic(&routine_task);
 }
 
-bool IrService::CanSendBufferNow() { return tx_state == 0x00000000; }
+bool IrService::CanSendBufferNow() { return mac.Idle(); }
 
-bool IrService::SendBuffer(const uint8_t *data, size_t len, bool send_header) {
-  if (tx_state != 0x00000000) {
+bool IrService::SendBuffer(const uint8_t *data, size_t len, bool send_header,
+                           IrPhy phy) {
+  if (!mac.Idle()) {
     // Can't send buffer now, we're handling another buffer.
     return false;
   }
@@ -141,79 +228,91 @@ bool IrService::SendBuffer(const uint8_t *data, size_t len, bool send_header) {
   tx_pending_buffer = data;
   tx_pending_buffer_len = len;
   tx_pending_send_header = send_header;
+  tx_pending_phy = phy;
 
   g_suspender.IncBlocker();
-  tx_state = 0x01000000;
+  if (mac.Chain()) {
+    // Right behind the last frame, from the next TX DMA half.
+    tx_pos = 0;
+    g_ir_stats.tx_chained++;
+  } else {
+    mac.Request();
+  }
 
   return true;
 }
 
-void IrService::SetOnBufferReceived(callback_t callback, void *callback_arg1) {
-  on_rx_buffer_cb = callback;
-  on_rx_buffer_arg = callback_arg1;
+void IrService::SetOnTxDone(callback_t callback, void *callback_arg1) {
+  tx_done_callback = callback;
+  tx_done_callback_arg = callback_arg1;
 }
 
+void IrService::SetRxDecoder(IrDecoder *decoder) { rx_decoder = decoder; }
+
 void IrService::PopulateTxDmaBuffer(void *ptr_side) {
   int side = reinterpret_cast<intptr_t>(ptr_side);
 
-  uint32_t cstate = tx_state >> 24;
-  int dma_base = (-side) & static_cast<int>(IR_SERVICE_TX_SIZE);
-  if (cstate <= 2) {
+  uint16_t *out =
+      &tx_dma_buffer[(-side) & static_cast<int>(IR_SERVICE_TX_SIZE)];
+  if (!mac.Sending()) {
     // Not transmitting.
-    for (int i = 0; i < IR_SERVICE_TX_SIZE; i++) {
-      tx_dma_buffer[dma_base + i] = 0;
-    }
-  } else if (cstate == 3) {
-    // Send header.
-    size_t ctr = tx_state & 0x00FFFFFF;
-    size_t base = ctr * IR_PACKET_PER_RUN;
-    for (int i = 0; i < IR_SERVICE_TX_SIZE; i++) {
-      tx_dma_buffer[dma_base + i] =
-          (-static_cast<int16_t>(IR_PACKET_HEADER[base + i / 8])) &
-          IR_PWM_TIM_CCR;
+    for (size_t i = 0; i < IR_SERVICE_TX_SIZE; i++) {
+      out[i] = 0;
     }
-    tx_state++;
-    if (ctr == IR_PACKET_RUN_COUNT - 1) {
-      // Done.
-      tx_state = 0x04000000;
-    }
-  } else if (cstate == 4) {
-    // Send body.
-    size_t ctr = tx_state & 0x00FFFFFF;
-    size_t base_bit = ctr * IR_BITS_PER_TX_RUN;
-    int i = 0;
-    for (int j = 0; j < IR_BITS_PER_TX_RUN; j++, base_bit++) {
-      int cbit = (tx_pending_buffer[base_bit / 8] >> (base_bit % 8)) & 0x01;
-      int16_t ccr_val = (-static_cast<int16_t>(cbit)) & IR_PWM_TIM_CCR;
-      for (int k = 0; k < PULSE_PER_DATA_BIT; k++, i++) {
-        tx_dma_buffer[dma_base + i] = ccr_val;
-      }
+    return;
+  }
+
+  // Entries of the frame sent before this half.
+  size_t pos = tx_pos;
+  bool fast = tx_pending_phy == IrPhy::kFast;
+  const uint8_t *header = fast ? IR_PACKET_HEADER_FAST : IR_PACKET_HEADER;
+  size_t header_entries =
+      tx_pending_send_header
+          ? (fast ? IR_PACKET_HEADER_FAST_SIZE : IR_PACKET_HEADER_SIZE) *
+                IR_TX_ENTRY_PER_HEADER_BIT
+          : 0;
+  size_t entry_per_bit =
+      fast ? IR_TX_ENTRY_PER_DATA_BIT_FAST : IR_TX_ENTRY_PER_DATA_BIT;
+  size_t frame_entries =
+      header_entries + tx_pending_buffer_len * 8 * entry_per_bit;
+  // One run per header element or data bit, padded with off after the frame.
+  size_t i = 0;
+  while (i < IR_SERVICE_TX_SIZE) {
+    size_t at = pos + i;
+    bool on = false;
+    size_t run = IR_SERVICE_TX_SIZE - i;
+    if (at < header_entries) {
+      on = header[at / IR_TX_ENTRY_PER_HEADER_BIT];
+      run = IR_TX_ENTRY_PER_HEADER_BIT - at % IR_TX_ENTRY_PER_HEADER_BIT;
+    } else if (at < frame_entries) {
+      size_t bit = (at - header_entries) / entry_per_bit;
+      on = (tx_pending_buffer[bit / 8] >> (bit % 8)) & 0x01;
+      run = entry_per_bit - (at - header_entries) % entry_per_bit;
     }
-    tx_state++;
-    if (ctr + 1 == (tx_pending_buffer_len * 8 / IR_BITS_PER_TX_RUN)) {
-      // Transmission done.
-      tx_state = 0x00000000;
-      g_suspender.DecBlocker();
-      tx_packet_cnt++;
+    if (run > IR_SERVICE_TX_SIZE - i) run = IR_SERVICE_TX_SIZE - i;
+    uint16_t ccr_val = (-static_cast<int16_t>(on)) & IR_PWM_TIM_CCR;
+    for (size_t end = i + run; i < end; i++) {
+      out[i] = ccr_val;
     }
-  } else {
-    my_assert(false);
+  }
+
+  tx_pos = pos + IR_SERVICE_TX_SIZE;
+  if (tx_pos >= frame_entries) {
+    // Transmission done.
+    mac.Done();
+    g_suspender.DecBlocker();
+    g_ir_stats.tx_frames++;
+    if (tx_done_callback) tx_done_callback(tx_done_callback_arg, nullptr);
   }
 }
 
 void IrService::Routine(void *arg1) {
-  rx_required_quiet_period = 20 + g_fast_random_pool.GetRandom() % 32;
-  if (rx_ctr_since_release >= 100000) rx_ctr_since_release = 100000;
-
-  if (tx_state >> 24 == 0x02) {
-    // Collision, let's wait randomly.
-    tx_state++;
-    int collision_wait = tx_state & 0x00FFFFFF;
-    if (collision_wait >= (32 + g_fast_random_pool.GetRandom() % 64)) {
-      // Wait's over, retransmit.
-      tx_state = 0x01000000;
-    }
-  }
+#ifdef IR_RX_CAPTURE
+  // Edges only queue a pull when the ring fills up, catch up on the rest and
+  // on the silence after them here.
+  if (!rx_edge_pull_queued) PullRxEdges(nullptr);
+#endif  // IR_RX_CAPTURE
+  mac.Routine(g_fast_random_pool.GetRandom());
 }
 
 }  // namespace ir
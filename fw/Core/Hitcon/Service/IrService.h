@@ -1,7 +1,11 @@
 #ifndef HITCON_SERVICE_IR_SERVICE_H_
 #define HITCON_SERVICE_IR_SERVICE_H_
 
+#include <Logic/IrDecoder.h>
+#include <Logic/IrEdgeSampler.h>
+#include <Logic/IrMac.h>
 #include <Service/IrParam.h>
+#include <Service/Sched/IsrQueue.h>
 #include <Service/Sched/PeriodicTask.h>
 #include <Service/Sched/Scheduler.h>
 #include <Util/callback.h>
@@ -18,43 +22,55 @@ class IrService {
   // Init should:
   // - Setup TIM3 to run at 38kHz.
   // - Setup TIM3_CH3 to output PWM.
-  // - Setup DMA1 CH2 to read from IrService's pwm_buffer.
+  // - Setup DMA1 CH2 to write TIM3 CCR3 from tx_dma_buffer on every TIM2
+  //   update, once every IR_TX_PULSE_PER_ENTRY pulses.
   //   (Double buffering should be used)
   // - Setup TIM2 to run at 9.5kHz.
   // - Setup TIM2 CH3.
-  // - Setup DMA1 CH1 to read PA on every TIM2 CH3 event.
+  // - Setup DMA1 CH1 to read PA on every TIM2 CH3 event, a word from IDR
+  //   and a byte to memory, which keeps the low byte.
   //   (Double buffering should be used)
+  // With IR_RX_CAPTURE, TIM2 instead free runs on the TIM3 updates and
+  // captures every edge of PA0 on TIM2 CH1 with an interrupt.
   void Init();
 
   // Return true if the IrService is free to send a buffer now.
   bool CanSendBufferNow();
 
   // Call to send an IR packet.
-  // This is a packed bit array, each bit is PULSE_PER_DATA_BIT pulse at 38kHz.
+  // This is a packed bit array, each bit is PULSE_PER_DATA_BIT pulse at 38kHz,
+  // or PULSE_PER_DATA_BIT_FAST with IrPhy::kFast.
   // The least significant bit of a byte is the first transmitted bit.
   // Caller must guarantee that the buffer is valid and not changed during the
   // whole transmission process.
-  // If send_header is true, we'll prepend the header during transmission.
-  bool SendBuffer(const uint8_t* data, size_t len, bool send_header);
-
-  // Whenever we've collected of IR_SERVICE_RX_ON_BUFFER_SIZE bytes of receive
-  // buffer, we'll call the specified function.
-  // The callback is called with a uint8_t pointer to an array of size
-  // IR_SERVICE_RX_ON_BUFFER_SIZE bytes. Each byte in the array is 8 sample
-  // points. Each of the sample point is equivalent to 4 pulse at 38kHz. After
-  // the callback is finished, the passed in buffer should be considered
-  // invalid.
-  void SetOnBufferReceived(callback_t callback, void* callback_arg1);
-
-  uint16_t rx_dma_buffer[2 * IR_SERVICE_RX_SIZE];
+  // If send_header is true, we'll prepend the header of phy during
+  // transmission.
+  // Called from the TX done callback, the buffer follows the last one on the
+  // same channel access, see IrMac::Chain().
+  bool SendBuffer(const uint8_t* data, size_t len, bool send_header,
+                  IrPhy phy = IrPhy::kNormal);
+
+  // callback(callback_arg1, nullptr) runs from the TX DMA task once the
+  // buffer of a SendBuffer() is out, and should only start the next one.
+  void SetOnTxDone(callback_t callback, void* callback_arg1);
+
+  // Every RX DMA half is packed into IR_BYTE_PER_RUN bytes of 8 samples
+  // each, LSB first, and fed to decoder in the same pass. Each sample point is
+  // equivalent to 4 pulse at 38kHz. decoder's callback runs in the RX DMA
+  // task, so it should only hand the packet off.
+  // The input capture receiver feeds the same bytes, rebuilt from the edges.
+  void SetRxDecoder(IrDecoder* decoder);
+
+  // % of time in last 30 second whereby there's a transmission.
+  // 100 => 100%
+  // 0 => 0%
+  int GetLoadFactor();
+
+#ifndef IR_RX_CAPTURE
+  // Low byte of GPIOA IDR per sample, see PackRxSamples().
+  alignas(4) uint8_t rx_dma_buffer[2 * IR_SERVICE_RX_SIZE];
+#endif  // IR_RX_CAPTURE
   uint16_t tx_dma_buffer[2 * IR_SERVICE_TX_SIZE];
-  uint8_t rx_buffer[2 * IR_SERVICE_RX_ON_BUFFER_SIZE];
-  size_t rx_buffer_base;
-
-  uint8_t calllback_pass_arr[IR_SERVICE_RX_SIZE];
-
-  callback_t on_rx_buffer_cb;
-  void* on_rx_buffer_arg;
 
   // Need to be public to be queued by the callback.
   hitcon::service::sched::Task dma_tx_populate_task;
@@ -62,55 +78,71 @@ class IrService {
   // Need to be public to be queued by the callback.
   hitcon::service::sched::Task dma_rx_pull_task;
 
+#ifdef IR_RX_CAPTURE
+  // Called by TIM2_IRQHandler on a TIM2 CH1 capture.
+  void OnRxEdge();
+#endif  // IR_RX_CAPTURE
+
+  // Used by the DMA callbacks to queue the tasks above without masking
+  // interrupts, one per DMA channel.
+  hitcon::service::sched::IsrQueue rx_isr_queue;
+  hitcon::service::sched::IsrQueue tx_isr_queue;
+
  private:
   const uint8_t* tx_pending_buffer;
   uint32_t tx_pending_buffer_len;
   // If false, will skip sending header.
   bool tx_pending_send_header;
+  IrPhy tx_pending_phy;
 
-  /*
-  MSB meaning:
-  0x00 - Ready to accept the next buffer.
-  0x01 - Waiting for air space to silent.
-  0x02 - Waiting for collision to finish.
-  0x03 - Sending header.
-  0x04 - Sending body.
-  */
-  uint32_t tx_state;
+  // Channel access for the frame in tx_pending_buffer.
+  IrMac mac;
 
-  // How long has rx been quiet?
-  // This is in units of 8/DECODE_SAMPLE_RATIO bit time.
-  size_t rx_quiet_cnt;
+  // TX DMA entries of the frame populated so far.
+  size_t tx_pos;
 
-  // How long should we wait until we transmit?
-  size_t rx_required_quiet_period;
+  callback_t tx_done_callback;
+  void* tx_done_callback_arg;
 
-  // How many RX DMA Run since the tx is released?
-  size_t rx_ctr_since_release;
+  hitcon::service::sched::PeriodicTask routine_task;
 
-  // How many packets has been sent?
-  // Primarily used for debugging.
-  size_t tx_packet_cnt;
+  IrDecoder* rx_decoder;
 
-  hitcon::service::sched::PeriodicTask routine_task;
+#ifdef IR_RX_CAPTURE
+  friend class IrEdgeSampler<IrService>;
+
+  // Edge ring filled by OnRxEdge(), the capture time of each edge and in
+  // rx_edge_levels the line level after it, 1 is on.
+  uint16_t rx_edges[IR_RX_EDGE_RING_SIZE];
+  uint16_t rx_edge_levels = 0;
+  // Free running indices, only OnRxEdge() writes head.
+  volatile uint8_t rx_edge_head = 0;
+  uint8_t rx_edge_tail = 0;
+  // dma_rx_pull_task is in rx_isr_queue and not yet run.
+  volatile bool rx_edge_pull_queued = false;
 
-  hitcon::service::sched::Task on_rx_callback_runner;
+  IrEdgeSampler<IrService> rx_sampler;
 
-  bool rx_on_buffer_callback_finished;
+  // Drain the edge ring and sample the line up to now.
+  void PullRxEdges(void* unused);
+
+  // Sink of rx_sampler.
+  void OnRxByte(uint8_t byte);
+  void OnRxSilence(size_t bytes);
+#endif  // IR_RX_CAPTURE
 
   // Call to populate TX DMA Buffer.
   // ptr_side is to be reinterpret_cast<int>(), and will be 0 or 1.
   void PopulateTxDmaBuffer(void* ptr_side);
 
+#ifndef IR_RX_CAPTURE
   // Call to pull RX DMA Buffer.
   // ptr_side is to be reinterpret_cast<int>(), and will be 0 or 1.
   void PullRxDmaBuffer(void* ptr_side);
+#endif  // IR_RX_CAPTURE
 
   // A slow routine function to keep track of states.
   void Routine(void* arg1);
-
-  // Just a wrapper for calling on_rx_buffer_cb.
-  void OnBufferRecvWrapper(void* arg2);
 };
 
 extern IrService irService;
@@ -1,11 +1,14 @@
 #include <Service/Sched/Checks.h>
+#include <stdlib.h>
 
 namespace hitcon {
 namespace service {
 namespace sched {
 
 void my_assert(bool expr) {
-#ifdef DEBUG
+#if defined(HITCON_TEST_MODE)
+  if (!expr) abort();
+#elif defined(DEBUG)
   if (!expr) {
     ((char*)nullptr)[0] = 0;
   }
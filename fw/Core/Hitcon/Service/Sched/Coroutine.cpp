@@ -0,0 +1,76 @@
+#include "Coroutine.h"
+
+#include <stdint.h>
+
+#include "Scheduler.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+namespace {
+
+alignas(8) uint8_t frames[kCoFrames][kCoFrameSize];
+bool frame_used[kCoFrames];
+#ifdef HITCON_TEST_MODE
+size_t frame_high_water;
+#endif  // HITCON_TEST_MODE
+
+}  // namespace
+
+#ifdef HITCON_TEST_MODE
+size_t CoFrameHighWater() { return frame_high_water; }
+#endif  // HITCON_TEST_MODE
+
+void *Coroutine::promise_type::operator new(size_t size) noexcept {
+#ifdef HITCON_TEST_MODE
+  if (size > frame_high_water) frame_high_water = size;
+#endif  // HITCON_TEST_MODE
+  if (size > kCoFrameSize) {
+    // Increase kCoFrameSize.
+    AssertOverflow();
+    return nullptr;
+  }
+  for (size_t i = 0; i < kCoFrames; i++) {
+    if (!frame_used[i]) {
+      frame_used[i] = true;
+      return frames[i];
+    }
+  }
+  // Every frame is taken, Start() returns false and the owner retries later.
+  return nullptr;
+}
+
+void Coroutine::promise_type::operator delete(void *frame, size_t size) {
+  size_t i = (static_cast<uint8_t *>(frame) - &frames[0][0]) / kCoFrameSize;
+  my_assert(i < kCoFrames && frame_used[i]);
+  frame_used[i] = false;
+}
+
+bool CoTask::Start(Coroutine co) {
+  my_assert(!IsRunning());
+  if (!co.handle) return false;
+  handle = co.handle;
+  scheduler.Queue(this, nullptr);
+  return true;
+}
+
+void CoTask::Wake() {
+  my_assert(IsRunning());
+  scheduler.Queue(this, nullptr);
+}
+
+void CoTask::Resume(void *unused) {
+  handle.promise().yielded = false;
+  handle.resume();
+  if (handle.done()) {
+    handle.destroy();
+    handle = nullptr;
+  } else if (handle.promise().yielded) {
+    scheduler.Queue(this, nullptr);
+  }
+}
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
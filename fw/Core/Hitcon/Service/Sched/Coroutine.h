@@ -0,0 +1,138 @@
+#ifndef HITCON_SERVICE_SCHED_COROUTINE_H_
+#define HITCON_SERVICE_SCHED_COROUTINE_H_
+
+#include <Service/Sched/Checks.h>
+#include <Service/Sched/Task.h>
+#include <stddef.h>
+
+#include <coroutine>
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Coroutine tasks
+---------------
+
+A long computation can be written as a straight line coroutine instead of a
+hand split state machine:
+
+  Coroutine HashService::Run() {
+    for (...) {
+      keccakf_split(...);
+      co_await YieldSlice();
+    }
+    callback(...);
+  }
+
+  hashTask.Start(Run());
+
+The CoTask resumes the coroutine from the scheduler. Every co_await
+YieldSlice() ends the current slice and queues the task again, just like a
+task that calls Queue() on itself. co_await WaitWake() ends the slice without
+queueing, someone else (e.g. the callback of an async service) calls
+CoTask::Wake() to continue.
+
+Frames come from a static pool of kCoFrames blocks of kCoFrameSize bytes
+instead of the heap. A coroutine must not have a frame bigger than that, and
+Start() returns false while kCoFrames coroutines exist. Coroutines can't
+co_return a value or await each other, keep state in the owning service.
+*/
+
+// Sized for the coroutines in the tree with some room. Frames are no smaller
+// on the host, with 8 byte pointers, so test-coroutine checks the ones in the
+// tree against kCoFrameSizeBadge. The host pool has room for test coroutines.
+constexpr size_t kCoFrameSizeBadge = 128;
+#ifdef HITCON_TEST_MODE
+constexpr size_t kCoFrameSize = 2 * kCoFrameSizeBadge;
+#else
+constexpr size_t kCoFrameSize = kCoFrameSizeBadge;
+#endif
+// One per CoTask in the tree, HashService::doHash() and
+// PointMultService::routineFunc(). A CoTask runs one coroutine at a time, so
+// both can be busy at once but never need a third frame. Add one for every
+// new CoTask.
+constexpr size_t kCoFrames = 2;
+
+#ifdef HITCON_TEST_MODE
+// Largest frame asked of the pool so far.
+size_t CoFrameHighWater();
+#endif  // HITCON_TEST_MODE
+
+class Coroutine {
+ public:
+  struct promise_type {
+    // Set by YieldSlice(), cleared on every resume.
+    bool yielded = false;
+
+    static void *operator new(size_t size) noexcept;
+    static void operator delete(void *frame, size_t size);
+
+    Coroutine get_return_object() {
+      return Coroutine(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    // Pool is exhausted, or the frame is too big.
+    static Coroutine get_return_object_on_allocation_failure() {
+      return Coroutine(nullptr);
+    }
+    // Don't start until the CoTask runs.
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    // CoTask frees the frame once it sees done().
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { my_assert(false); }
+  };
+
+  explicit Coroutine(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+  friend class CoTask;
+};
+
+struct YieldSliceAwaiter {
+  bool await_ready() noexcept { return false; }
+  void await_suspend(std::coroutine_handle<Coroutine::promise_type> h) {
+    h.promise().yielded = true;
+  }
+  void await_resume() noexcept {}
+};
+
+// End this slice and continue in the next one.
+inline YieldSliceAwaiter YieldSlice() { return {}; }
+
+// End this slice and continue once the CoTask is woken with Wake().
+inline std::suspend_always WaitWake() { return {}; }
+
+// A Task that runs a Coroutine.
+class CoTask : public Task {
+ public:
+  // For prio, see Scheduler.h
+  constexpr CoTask(unsigned prio)
+      : Task(prio, (task_callback_t)&CoTask::Resume, this), handle(nullptr) {}
+
+  // Start running co, the task must not be running a coroutine already.
+  // Returns false if co couldn't get a frame, every one is taken.
+  bool Start(Coroutine co);
+
+  // Continue a coroutine waiting in WaitWake(). Can NOT be called during
+  // interrupt.
+  void Wake();
+
+  // Has a coroutine that hasn't finished yet?
+  bool IsRunning() { return static_cast<bool>(handle); }
+
+ private:
+  std::coroutine_handle<Coroutine::promise_type> handle;
+
+  void Resume(void *unused);
+};
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_COROUTINE_H_ */
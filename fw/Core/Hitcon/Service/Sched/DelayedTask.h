@@ -14,22 +14,37 @@ namespace hitcon {
 namespace service {
 namespace sched {
 
+template <class T, unsigned kSlotBits>
+class TimerWheel;
+
 class DelayedTask : public Task {
  protected:
   unsigned wakeTime;
 
+ private:
+  // Intrusive links for TimerWheel.
+  DelayedTask *wheel_next;
+  DelayedTask **wheel_pprev;
+
+  template <class T, unsigned kSlotBits>
+  friend class TimerWheel;
+
  public:
+  // QueueIdx() of a task waiting in the scheduler's timer wheel.
+  static constexpr unsigned kInTimerWheel = kNotQueued - 1;
+
   // For prio, see Scheduler.h
   constexpr DelayedTask(unsigned prio, task_callback_t callback, void *thisptr,
                         unsigned wakeTime)
-      : Task(prio, callback, thisptr), wakeTime(wakeTime) {}
+      : Task(prio, callback, thisptr), wakeTime(wakeTime),
+        wheel_next(nullptr), wheel_pprev(nullptr) {}
 
   virtual ~DelayedTask();
 
   unsigned WakeTime();
 
   void SetWakeTime(unsigned wakeTimeIn) {
-    my_assert(!in_queue);
+    my_assert(!IsQueued());
     wakeTime = wakeTimeIn;
   }
   bool operator<(DelayedTask &task);
@@ -14,30 +14,33 @@ namespace hitcon {
 namespace service {
 namespace sched {
 
+// Unordered set of T*. T must provide ArrayIdx() and SetArrayIdx(), which the
+// array keeps equal to the slot each element is stored in. An element may be in
+// at most one Array at a time.
 template <class T, unsigned capacity>
 class Array {
   unsigned sz;
   T *storage[capacity];
 
- private:
-  unsigned GetIdx(T &t) {
-    for (unsigned i = 0; i < sz; ++i) {
-      if (t == *storage[i]) return i;
-    }
-    return sz;
-  }
-
  public:
   bool Add(T *t) {
     if (sz >= capacity) return false;
+    t->SetArrayIdx(sz);
     storage[sz++] = t;
     return true;
   }
 
+  // Is t in this array?
+  bool Contains(T *t) {
+    unsigned idx = t->ArrayIdx();
+    return idx < sz && storage[idx] == t;
+  }
+
   bool Remove(T *t) {
-    unsigned idx = GetIdx(*t);
-    if (idx == sz) return false;
+    if (!Contains(t)) return false;
+    unsigned idx = t->ArrayIdx();
     storage[idx] = storage[--sz];
+    storage[idx]->SetArrayIdx(idx);
     return true;
   }
 };
@@ -0,0 +1,91 @@
+#ifndef HITCON_SERVICE_SCHED_DS_BUCKETQUEUE_H_
+#define HITCON_SERVICE_SCHED_DS_BUCKETQUEUE_H_
+
+#include <Common.h>
+#include <Service/Sched/Checks.h>
+#include <stdint.h>
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Priority queue of T* with 32 FIFO buckets, one per band of priorities.
+
+An element goes into bucket T::prio >> kBandShift, lower buckets come out
+first and elements in the same bucket come out in the order they were added.
+A bitmap of non-empty buckets is kept so Top() is a single count leading zeros
+and Add()/Remove() of the top are O(1). Removing anything else walks its
+bucket.
+
+Elements are linked intrusively through T::ready_next, so there's no capacity
+limit. T::QueueIdx() is set to T::kInBucketQueue while the element is queued.
+*/
+template <class T, unsigned kBandShift>
+class BucketQueue {
+ public:
+  static constexpr unsigned kBuckets = 32;
+
+  BucketQueue() {}
+
+  void Add(T *t) {
+    unsigned bucket = t->prio >> kBandShift;
+    my_assert(bucket < kBuckets);
+    t->ready_next = nullptr;
+    if (tail[bucket]) {
+      tail[bucket]->ready_next = t;
+    } else {
+      head[bucket] = t;
+      bitmap |= Bit(bucket);
+    }
+    tail[bucket] = t;
+    t->SetQueueIdx(T::kInBucketQueue);
+    sz++;
+  }
+
+  bool Contains(T *t) { return t->QueueIdx() == T::kInBucketQueue; }
+
+  bool Remove(T *t) {
+    if (!Contains(t)) return false;
+    unsigned bucket = t->prio >> kBandShift;
+    T *prev = nullptr;
+    T *cur = head[bucket];
+    while (cur != t) {
+      prev = cur;
+      cur = cur->ready_next;
+    }
+    if (prev) {
+      prev->ready_next = t->ready_next;
+    } else {
+      head[bucket] = t->ready_next;
+    }
+    if (tail[bucket] == t) tail[bucket] = prev;
+    if (!head[bucket]) bitmap &= ~Bit(bucket);
+    t->ready_next = nullptr;
+    t->SetQueueIdx(T::kNotQueued);
+    sz--;
+    return true;
+  }
+
+  // Queue must not be empty.
+  T &Top() { return *head[__builtin_clz(bitmap)]; }
+
+  unsigned size() { return sz; }
+
+ private:
+  // Bucket 0 is the MSB so count leading zeros gives the first bucket.
+  static constexpr uint32_t Bit(unsigned bucket) {
+    return 0x80000000u >> bucket;
+  }
+
+  uint32_t bitmap;
+  T *head[kBuckets];
+  T *tail[kBuckets];
+  unsigned sz;
+};
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_DS_BUCKETQUEUE_H_ */
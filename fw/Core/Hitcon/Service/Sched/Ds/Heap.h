@@ -24,45 +24,45 @@ inline unsigned ChildIdx2(unsigned i) { return (i * 2) + 2; }
 
 } /* namespace heap */
 
+// Binary min-heap of T*. T must provide QueueIdx() and SetQueueIdx(), which
+// the heap keeps equal to the slot each element is stored in, so removal and
+// membership checks don't have to search.
 template <class T, unsigned capacity>
 class Heap {
   unsigned sz;
   T *storage[capacity];
 
  private:
-  unsigned GetIdx(T &t) {
-    for (unsigned i = 0; i < sz; ++i) {
-      if (t == *storage[i]) return i;
-    }
-    return sz;
+  void Place(unsigned i, T *t) {
+    storage[i] = t;
+    t->SetQueueIdx(i);
   }
 
-  void Heapify(unsigned i) {
+  // Returns the index that storage[i] ended up in.
+  unsigned Heapify(unsigned i) {
+    T *t = storage[i];
     while (i > 0) {
       unsigned parIdx = heap::ParentIdx(i);
-      T **cur = &storage[i], **par = &storage[parIdx];
-      if (**cur < **par) {
-        T *tmp1 = *cur;
-        *cur = *par;
-        *par = tmp1;
-      }
+      if (!(*t < *storage[parIdx])) break;
+      Place(i, storage[parIdx]);
       i = parIdx;
     }
+    Place(i, t);
+    return i;
   }
 
   void ReverseHeapify(unsigned i) {
+    T *t = storage[i];
     while (heap::ChildIdx1(i) < sz) {
       unsigned i1 = heap::ChildIdx1(i);
       unsigned i2 = heap::ChildIdx2(i);
-      unsigned smallest = i;
-      if (i1 < sz && *storage[i1] < *storage[smallest]) smallest = i1;
-      if (i2 < sz && *storage[i2] < *storage[smallest]) smallest = i2;
-      if (i == smallest) break;
-      T *tmp1 = storage[i];
-      storage[i] = storage[smallest];
-      storage[smallest] = tmp1;
+      unsigned smallest = i1;
+      if (i2 < sz && *storage[i2] < *storage[i1]) smallest = i2;
+      if (!(*storage[smallest] < *t)) break;
+      Place(i, storage[smallest]);
       i = smallest;
     }
+    Place(i, t);
   }
 
  public:
@@ -77,12 +77,21 @@ class Heap {
     return true;
   }
 
+  // Is t in this heap?
+  bool Contains(T *t) {
+    unsigned idx = t->QueueIdx();
+    return idx < sz && storage[idx] == t;
+  }
+
   bool Remove(T *t) {
-    unsigned idx = GetIdx(*t);
-    if (idx == sz) return false;
-    storage[idx] = storage[--sz];
+    if (!Contains(t)) return false;
+    unsigned idx = t->QueueIdx();
+    t->SetQueueIdx(T::kNotQueued);
+    T *last = storage[--sz];
     storage[sz] = nullptr;
-    ReverseHeapify(idx);
+    if (idx == sz) return true;
+    storage[idx] = last;
+    if (Heapify(idx) == idx) ReverseHeapify(idx);
     return true;
   }
 
@@ -0,0 +1,159 @@
+#ifndef HITCON_SERVICE_SCHED_DS_TIMERWHEEL_H_
+#define HITCON_SERVICE_SCHED_DS_TIMERWHEEL_H_
+
+#include <Common.h>
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Two level hierarchical timer wheel, keyed by T::WakeTime() in ticks.
+
+Level 0 has one slot per tick and covers the next kSlots ticks. Level 1 has
+one slot per kSlots ticks and covers the next kSlots * kSlots ticks. Anything
+further out is parked in an overflow list that's revisited every time level 1
+wraps around. Whenever level 0 wraps around, the matching level 1 slot is
+cascaded down into level 0.
+
+Elements are linked intrusively through T::wheel_next and T::wheel_pprev, so
+there's no capacity limit and Add()/Remove() are O(1). T::QueueIdx() is set to
+T::kInTimerWheel while the element is in the wheel.
+*/
+template <class T, unsigned kSlotBits>
+class TimerWheel {
+ public:
+  static constexpr unsigned kSlots = 1u << kSlotBits;
+  static constexpr unsigned kSlotMask = kSlots - 1;
+
+  TimerWheel() {}
+
+  // Caller must make sure t->WakeTime() is after the last Advance() time.
+  void Add(T *t) {
+    Place(t);
+    t->SetQueueIdx(T::kInTimerWheel);
+    sz++;
+  }
+
+  bool Contains(T *t) { return t->QueueIdx() == T::kInTimerWheel; }
+
+  bool Remove(T *t) {
+    if (!Contains(t)) return false;
+    Unlink(t);
+    t->SetQueueIdx(T::kNotQueued);
+    sz--;
+    return true;
+  }
+
+  // Expire everything with WakeTime() <= now. on_expire(T*) is called for each
+  // expired element after it's been taken off the wheel, a whole slot at a
+  // time.
+  template <class Fn>
+  void Advance(unsigned now, Fn &&on_expire) {
+    if (!sz) {
+      // Nothing to cascade, skip ahead.
+      if (now >= current) current = now + 1;
+      return;
+    }
+    while (current <= now) {
+      unsigned idx0 = current & kSlotMask;
+      if (idx0 == 0) {
+        unsigned idx1 = (current >> kSlotBits) & kSlotMask;
+        if (idx1 == 0) Cascade(&overflow);
+        Cascade(&level1[idx1]);
+      }
+      T *t = Detach(&level0[idx0]);
+      while (t) {
+        T *next = t->wheel_next;
+        t->SetQueueIdx(T::kNotQueued);
+        sz--;
+        on_expire(t);
+        t = next;
+      }
+      current++;
+      if (!sz) {
+        if (now >= current) current = now + 1;
+        return;
+      }
+    }
+  }
+
+  // Earliest tick at which Advance() may have something to expire. This is
+  // exact for level 0 and conservative for level 1/overflow: it returns the
+  // tick those are cascaded at. Returns false if the wheel is empty.
+  bool NextWakeTime(unsigned *wake) {
+    if (!sz) return false;
+    for (unsigned t = current; t != current + kSlots; t++) {
+      if ((t & kSlotMask) == 0) {
+        unsigned idx1 = (t >> kSlotBits) & kSlotMask;
+        if (level1[idx1] || (idx1 == 0 && overflow)) {
+          *wake = t;
+          return true;
+        }
+      }
+      if (level0[t & kSlotMask]) {
+        *wake = t;
+        return true;
+      }
+    }
+    // Level 0 is empty and the next cascade is exactly kSlots away.
+    *wake = current + kSlots;
+    return true;
+  }
+
+  unsigned size() { return sz; }
+
+ private:
+  T *level0[kSlots];
+  T *level1[kSlots];
+  T *overflow;
+  // The next tick that Advance() has not expired yet.
+  unsigned current;
+  unsigned sz;
+
+  void Place(T *t) {
+    unsigned wake = t->WakeTime();
+    if (wake < current) wake = current;
+    unsigned delta = wake - current;
+    T **head;
+    if (delta < kSlots) {
+      head = &level0[wake & kSlotMask];
+    } else if (delta < kSlots * kSlots) {
+      head = &level1[(wake >> kSlotBits) & kSlotMask];
+    } else {
+      head = &overflow;
+    }
+    t->wheel_next = *head;
+    if (*head) (*head)->wheel_pprev = &t->wheel_next;
+    t->wheel_pprev = head;
+    *head = t;
+  }
+
+  void Unlink(T *t) {
+    *t->wheel_pprev = t->wheel_next;
+    if (t->wheel_next) t->wheel_next->wheel_pprev = t->wheel_pprev;
+  }
+
+  // Take the whole list out of a slot.
+  T *Detach(T **head) {
+    T *t = *head;
+    *head = nullptr;
+    return t;
+  }
+
+  // Move everything in a slot to where it belongs relative to current.
+  void Cascade(T **head) {
+    T *t = Detach(head);
+    while (t) {
+      T *next = t->wheel_next;
+      Place(t);
+      t = next;
+    }
+  }
+};
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_DS_TIMERWHEEL_H_ */
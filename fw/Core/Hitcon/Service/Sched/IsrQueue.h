@@ -0,0 +1,92 @@
+#ifndef HITCON_SERVICE_SCHED_ISRQUEUE_H_
+#define HITCON_SERVICE_SCHED_ISRQUEUE_H_
+
+#include <Service/Sched/Checks.h>
+#include <Service/Sched/Profiler.h>
+#include <Service/Sched/SysTimer.h>
+#include <Service/Sched/Task.h>
+#include <stdint.h>
+
+#ifdef HITCON_TEST_MODE
+#include <Service/Sched/SimHal.h>
+#else
+#include <main.h>
+#endif
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Single producer, single consumer queue for handing tasks from one interrupt
+source to the scheduler without masking interrupts.
+
+Push() must only ever be called from one interrupt handler (or from code that
+the handler can't preempt), and Pop() only from the scheduler. Each side only
+writes its own index, so there's nothing to lock.
+
+Register the queue with Scheduler::AddIsrQueue() during Init().
+*/
+class IsrQueue {
+ public:
+  static constexpr uint8_t kCapacity = 4;
+
+  constexpr IsrQueue() : entries{}, head(0), tail(0), next(nullptr) {}
+
+  // Producer side, call from the owning interrupt.
+  bool Push(Task *task, void *arg) {
+    uint8_t h = head;
+    uint8_t n = (h + 1) % kCapacity;
+    if (n == tail) {
+      // Overflow, we need to drop this request.
+      AssertOverflow();
+      return false;
+    }
+    entries[h].task = task;
+    entries[h].arg = arg;
+    entries[h].ready_time = SysTimer::GetTime();
+    profiler.OnReady(task);
+    // Entry must be visible before the scheduler sees the new head.
+    __DMB();
+    head = n;
+    return true;
+  }
+
+  // Consumer side, scheduler only.
+  bool Pop(Task **task, void **arg, unsigned *ready_time) {
+    uint8_t t = tail;
+    if (t == head) return false;
+    *task = entries[t].task;
+    *arg = entries[t].arg;
+    *ready_time = entries[t].ready_time;
+    // Entry must be read before the slot is handed back to the producer.
+    __DMB();
+    tail = (t + 1) % kCapacity;
+    return true;
+  }
+
+  bool IsEmpty() { return head == tail; }
+
+ private:
+  struct Entry {
+    Task *task;
+    void *arg;
+    // SysTimer::GetTime() at Push(), deadlines count from here.
+    unsigned ready_time;
+  };
+  Entry entries[kCapacity];
+  // Only written by the producer.
+  volatile uint8_t head;
+  // Only written by the consumer.
+  volatile uint8_t tail;
+
+  // Scheduler's list of registered queues.
+  IsrQueue *next;
+  friend class Scheduler;
+};
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_ISRQUEUE_H_ */
@@ -20,6 +20,8 @@ class PeriodicTask : public DelayedTask {
   unsigned interval;
   void *savedThisptr;
   task_callback_t savedCallback;
+  // Slot in the scheduler's enabled/disabled periodic task array.
+  unsigned array_idx;
   void AutoRequeueCb(void *arg);
 
  public:
@@ -29,12 +31,16 @@ class PeriodicTask : public DelayedTask {
       : DelayedTask(prio, (task_callback_t)&PeriodicTask::AutoRequeueCb,
                     (void *)this, 0),
         enabled(false), interval(interval), savedThisptr(thisptr),
-        savedCallback(callback) {}
+        savedCallback(callback), array_idx(0) {}
 
   virtual ~PeriodicTask();
   void Enable();
   void Disable();
   bool IsEnabled() { return enabled; }
+
+  // Only for use by Array.
+  unsigned ArrayIdx() { return array_idx; }
+  void SetArrayIdx(unsigned idx) { array_idx = idx; }
 };
 
 } /* namespace sched */
@@ -0,0 +1,64 @@
+#include "Profiler.h"
+
+#include <string.h>
+
+#include "SysTimer.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+Profiler profiler;
+
+#ifdef SCHED_PROFILE
+
+void Profiler::Reset() {
+  memset(stats, 0, sizeof(stats));
+  dropped = 0;
+}
+
+void Profiler::OnReady(Task *task) {
+  task->SetReadyCycles(SysTimer::GetCycles());
+}
+
+void Profiler::OnRun(Task *task, uint32_t start, uint32_t end) {
+  // Open addressing on the task pointer.
+  size_t base = reinterpret_cast<uintptr_t>(task) >> 2;
+  TaskStats *entry = nullptr;
+  for (size_t i = 0; i < kProfileSlots; i++) {
+    TaskStats *cur = &stats[(base + i) % kProfileSlots];
+    if (cur->task == task || cur->task == nullptr) {
+      entry = cur;
+      break;
+    }
+  }
+  if (!entry) {
+    dropped++;
+    return;
+  }
+  entry->task = task;
+
+  uint32_t cycles = end - start;
+  uint32_t latency = start - task->GetReadyCycles();
+  entry->count++;
+  entry->total_cycles += cycles;
+  if (cycles > entry->max_cycles) entry->max_cycles = cycles;
+  entry->total_latency += latency;
+  if (latency > entry->max_latency) entry->max_latency = latency;
+
+  int bin = cycles ? 31 - __builtin_clz(cycles) - kProfileHistShift : 0;
+  if (bin < 0) bin = 0;
+  if (bin >= static_cast<int>(kProfileHistBins)) bin = kProfileHistBins - 1;
+  if (entry->hist[bin] != UINT16_MAX) entry->hist[bin]++;
+}
+
+TaskStats *Profiler::GetStats(size_t slot) {
+  if (slot >= kProfileSlots || !stats[slot].task) return nullptr;
+  return &stats[slot];
+}
+
+#endif  // SCHED_PROFILE
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
@@ -0,0 +1,79 @@
+#ifndef HITCON_SERVICE_SCHED_PROFILER_H_
+#define HITCON_SERVICE_SCHED_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Task.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Per task run time profiler.
+
+Only collects anything when built with SCHED_PROFILE defined, since the table
+costs about 1KB of RAM. All times are in SysTimer::GetCycles() units (DWT
+cycle counter, HCLK).
+
+Latency is measured from the moment a task is queued (or its wake time
+passes) to the moment the scheduler starts running it.
+*/
+
+constexpr size_t kProfileSlots = 16;
+constexpr size_t kProfileHistBins = 16;
+// hist[0] counts runs shorter than 2^(kProfileHistShift+1) cycles, hist[i]
+// counts runs of [2^(i+kProfileHistShift), 2^(i+kProfileHistShift+1)) cycles
+// and the last bin is open ended.
+constexpr unsigned kProfileHistShift = 6;
+
+// Layout is also the USB wire format, see UsbLogic. Keep it free of padding.
+struct TaskStats {
+  Task *task;
+  uint32_t count;
+  uint64_t total_cycles;
+  uint32_t max_cycles;
+  uint32_t max_latency;
+  uint64_t total_latency;
+  uint16_t hist[kProfileHistBins];
+};
+static_assert(sizeof(TaskStats) % 8 == 0);
+
+class Profiler {
+ public:
+#ifdef SCHED_PROFILE
+  // Clear all stats.
+  void Reset();
+
+  // Call whenever task becomes runnable. Can be called during interrupt.
+  void OnReady(Task *task);
+
+  // Call after task ran from start to end.
+  void OnRun(Task *task, uint32_t start, uint32_t end);
+
+  // nullptr if slot is unused or out of range.
+  TaskStats *GetStats(size_t slot);
+
+  // Runs that didn't fit in the table.
+  uint32_t GetDropped() { return dropped; }
+
+ private:
+  TaskStats stats[kProfileSlots];
+  uint32_t dropped;
+#else
+  void Reset() {}
+  void OnReady(Task *task) {}
+  void OnRun(Task *task, uint32_t start, uint32_t end) {}
+  TaskStats *GetStats(size_t slot) { return nullptr; }
+  uint32_t GetDropped() { return 0; }
+#endif  // SCHED_PROFILE
+};
+
+extern Profiler profiler;
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_PROFILER_H_ */
@@ -10,7 +10,12 @@
 #include <Service/Sched/Checks.h>
 
 #include "SysTimer.h"
+
+#ifdef HITCON_TEST_MODE
+#include "SimHal.h"
+#else
 #include "main.h"
+#endif
 
 namespace hitcon {
 namespace service {
@@ -25,6 +30,7 @@ Scheduler::~Scheduler() {}
 bool Scheduler::Queue(Task *task, void *arg) {
   my_assert(task);
   task->SetArg(arg);
+  profiler.OnReady(task);
   bool result = true;
   // TODO: Disable Interrupt.
   __disable_irq();
@@ -60,6 +66,11 @@ bool Scheduler::Queue(PeriodicTask *task, void *arg) {
   return disabledPeriodicTasks.Add(task);
 }
 
+void Scheduler::AddIsrQueue(IsrQueue *queue) {
+  queue->next = isrQueues;
+  isrQueues = queue;
+}
+
 bool Scheduler::EnablePeriodic(PeriodicTask *task) {
   if (!disabledPeriodicTasks.Remove(task)) {
     AssertOverflow();
@@ -70,11 +81,10 @@ bool Scheduler::EnablePeriodic(PeriodicTask *task) {
     return false;
   }
   if (currentTask != task) {
-    bool ret = delayedTasks.Add(task);
-    if (!ret) {
+    if (task->IsQueued()) {
       AssertOverflow();
     } else {
-      task->EnterQueue();
+      AddDelayed(task, SysTimer::GetTime());
     }
   }
   task->Enable();
@@ -91,86 +101,153 @@ bool Scheduler::DisablePeriodic(PeriodicTask *task) {
     return false;
   }
   DelayedHouseKeeping();
-  {
-    bool removed = tasks.Remove(task);
-    if (removed) {
-      task->ExitQueue();
-    }
-    removed = delayedTasks.Remove(task);
-    if (removed) {
-      task->ExitQueue();
-    }
+  if (!tasks.Remove(task) && !deadlineTasks.Remove(task)) {
+    delayedTasks.Remove(task);
   }
   task->Disable();
   return true;
 }
 
 void Scheduler::DelayedHouseKeeping() {
+  unsigned now = SysTimer::GetTime();
   // Handle all Queue operations.
   while (!tasksAddQueue.IsEmpty()) {
-    bool ret = tasks.Add(tasksAddQueue.Front());
-    if (!ret) {
+    Task *task = tasksAddQueue.Front();
+    if (task->IsQueued()) {
+      // Queued twice before it ran, drop the duplicate.
+      AssertOverflow();
+    } else if (!AddReady(task, now)) {
       // Heap is full.
       AssertOverflow();
       break;
     }
-    tasksAddQueue.Front()->EnterQueue();
     tasksAddQueue.PopFront();
   }
-  while (!delayedTasksAddQueue.IsEmpty()) {
-    bool ret = delayedTasks.Add(delayedTasksAddQueue.Front());
-    if (!ret) {
-      // Heap is full.
-      AssertOverflow();
-      break;
+  for (IsrQueue *queue = isrQueues; queue; queue = queue->next) {
+    Task *task;
+    void *arg;
+    unsigned ready_time;
+    while (queue->Pop(&task, &arg, &ready_time)) {
+      if (task->IsQueued()) {
+        // Queued twice before it ran, drop the duplicate.
+        AssertOverflow();
+        continue;
+      }
+      task->SetArg(arg);
+      bool ret = AddReady(task, ready_time);
+      if (!ret) AssertOverflow();
     }
-    delayedTasksAddQueue.Front()->EnterQueue();
-    delayedTasksAddQueue.PopFront();
   }
-  unsigned now = SysTimer::GetTime();
-  while (delayedTasks.size()) {
-    DelayedTask &top = delayedTasks.Top();
-    unsigned wake = top.WakeTime();
-    if (wake > now) break;
-    bool ret = delayedTasks.Remove(&top);
-    if (!ret) {
+  while (!delayedTasksAddQueue.IsEmpty()) {
+    DelayedTask *task = delayedTasksAddQueue.Front();
+    if (task->IsQueued()) {
+      // Queued twice before it ran, drop the duplicate.
       AssertOverflow();
     } else {
-      top.ExitQueue();
+      AddDelayed(task, now);
     }
-    ret = tasks.Add(&top);
-    if (!ret) {
-      AssertOverflow();
-    } else {
-      top.EnterQueue();
+    delayedTasksAddQueue.PopFront();
+  }
+  delayedTasks.Advance(now, [this](DelayedTask *task) {
+    profiler.OnReady(task);
+    bool ret = AddReady(task, task->WakeTime());
+    if (!ret) AssertOverflow();
+  });
+}
+
+bool Scheduler::AddReady(Task *task, unsigned ready_time) {
+  // Deadline is part of the heap order, only touch it while not queued.
+  if (task->HasDeadline()) {
+    task->StartDeadline(ready_time);
+    return deadlineTasks.Add(task);
+  }
+  tasks.Add(task);
+  return true;
+}
+
+void Scheduler::AddDelayed(DelayedTask *task, unsigned now) {
+  if (task->WakeTime() <= now) {
+    profiler.OnReady(task);
+    bool ret = AddReady(task, now);
+    if (!ret) AssertOverflow();
+  } else {
+    delayedTasks.Add(task);
+  }
+}
+
+void Scheduler::Idle() {
+  // Interrupts are masked from the check until WFI, so a Queue() from an
+  // interrupt either shows up in the add queues or wakes the WFI.
+  __disable_irq();
+  bool idle = tasksAddQueue.IsEmpty() && delayedTasksAddQueue.IsEmpty();
+  for (IsrQueue *queue = isrQueues; queue; queue = queue->next) {
+    if (!queue->IsEmpty()) idle = false;
+  }
+  if (idle) {
+    unsigned now = SysTimer::GetTime();
+    unsigned wake;
+    if (!delayedTasks.NextWakeTime(&wake)) {
+      // Only interrupts can give us work.
+      SysTimer::Sleep(~0u);
+    } else if (wake > now) {
+      SysTimer::Sleep(wake - now);
     }
   }
+  __enable_irq();
 }
 
 void Scheduler::Run() {
+  SysTimer::StartCycleCounter();
+  profiler.Reset();
   while (1) {
-    DelayedHouseKeeping();
-    if (!tasks.size()) continue;
-    Task &top = tasks.Top();
-    bool ret = tasks.Remove(&top);
-    if (!ret) {
-      AssertOverflow();
-    } else {
-      top.ExitQueue();
-    }
-    totalTasks++;
-    TaskRecord record;
-    record.startTime = SysTimer::GetTime();
-    record.task = &top;
-
-    currentTask = &top;
-    top.Run();
-    currentTask = nullptr;
-    record.endTime = SysTimer::GetTime();
-    taskRecords[record_index] = record;
-    record_index++;
-    if (record_index == kRecordSize) record_index = 0;
+    RunOnce();
+  }
+}
+
+#ifdef HITCON_TEST_MODE
+void Scheduler::RunUntil(unsigned time) {
+  while (SysTimer::GetTime() < time) {
+    RunOnce();
+  }
+}
+#endif  // HITCON_TEST_MODE
+
+void Scheduler::RunOnce() {
+  DelayedHouseKeeping();
+  Task *next;
+  bool ret;
+  if (deadlineTasks.size()) {
+    next = &deadlineTasks.Top();
+    ret = deadlineTasks.Remove(next);
+  } else if (tasks.size()) {
+    next = &tasks.Top();
+    ret = tasks.Remove(next);
+  } else {
+    Idle();
+    return;
+  }
+  if (!ret) AssertOverflow();
+  Task &top = *next;
+  totalTasks++;
+  if (top.HasDeadline() &&
+      static_cast<int>(SysTimer::GetTime() - top.Deadline()) > 0) {
+    missedDeadlines++;
+    lastMissedTask = &top;
   }
+  TaskRecord record;
+  record.startTime = SysTimer::GetCycles();
+  record.task = &top;
+
+  currentTask = &top;
+  slice_watchdog.OnStart(&top, record.startTime);
+  top.Run();
+  record.endTime = SysTimer::GetCycles();
+  slice_watchdog.OnEnd(record.endTime);
+  currentTask = nullptr;
+  profiler.OnRun(&top, record.startTime, record.endTime);
+  taskRecords[record_index] = record;
+  record_index++;
+  if (record_index == kRecordSize) record_index = 0;
 }
 
 } /* namespace sched */
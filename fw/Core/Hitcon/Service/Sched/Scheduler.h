@@ -15,9 +15,14 @@
 
 #include "DelayedTask.h"
 #include "Ds/Array.h"
+#include "Ds/BucketQueue.h"
 #include "Ds/Heap.h"
+#include "Ds/TimerWheel.h"
+#include "IsrQueue.h"
 #include "PeriodicTask.h"
+#include "Profiler.h"
 #include "Scheduler.h"
+#include "SliceWatchdog.h"
 #include "Task.h"
 
 namespace hitcon {
@@ -37,8 +42,24 @@ For real time task that has soft deadline, such as button detection, we use
 priority 300-400.
 For real time task that has hard deadline, such as display refresh/trigger,
 we use priority 100-200.
+
+Priorities are grouped in bands of 32 (0-31, 32-63, ...). Tasks in a lower
+band always run first, tasks in the same band run in the order they became
+runnable.
+
+Deadlines
+---------
+
+A task with Task::SetDeadline() is a deadline task. It must start within that
+many ticks of becoming runnable: Queue() (counted from when the scheduler picks
+it up), IsrQueue::Push() or its wake time for delayed tasks. Deadline tasks
+always run before best effort tasks, earliest deadline first, with prio only
+breaking ties. Tasks are never preempted, so a deadline can still be missed
+behind a long running task. Misses are counted in GetMissedDeadlines().
 */
 
+// Last few tasks that ran, for inspection with a debugger. Times are in
+// SysTimer::GetCycles().
 struct TaskRecord {
   Task *task;
   uint32_t startTime;
@@ -49,9 +70,17 @@ class Scheduler {
  private:
   static constexpr size_t kAddQueueSize = 8;
   static constexpr size_t kRecordSize = 20;
-
-  Heap<Task, 32> tasks;
-  Heap<DelayedTask, 24> delayedTasks;
+  // 32 slots per level, level 0 covers 32ms and level 1 covers ~1s, which
+  // holds every periodic interval we use without touching the overflow list.
+  static constexpr unsigned kWheelSlotBits = 5;
+  // Priority 0-1000 in bands of 32 fits the 32 buckets.
+  static constexpr unsigned kPrioBandShift = 5;
+
+  // Best effort ready tasks, bucketed by priority band.
+  BucketQueue<Task, kPrioBandShift> tasks;
+  // Ready tasks with a deadline, see Deadlines above.
+  Heap<Task, 8> deadlineTasks;
+  TimerWheel<DelayedTask, kWheelSlotBits> delayedTasks;
   Array<PeriodicTask, 24> enabledPeriodicTasks, disabledPeriodicTasks;
 
   // Queue used to temporarily hold calls to Queue() so we can defer heap
@@ -65,8 +94,12 @@ class Scheduler {
   size_t delayedTasksAddQueueTail = 0;*/
   CircularQueue<Task *, kAddQueueSize> tasksAddQueue;
   CircularQueue<DelayedTask *, kAddQueueSize> delayedTasksAddQueue;
+  // Per interrupt source queues registered with AddIsrQueue().
+  IsrQueue *isrQueues = nullptr;
 
   size_t totalTasks = 0;
+  size_t missedDeadlines = 0;
+  Task *lastMissedTask = nullptr;
 
   TaskRecord taskRecords[kRecordSize];
   size_t record_index{0};
@@ -74,6 +107,16 @@ class Scheduler {
   Task *currentTask = nullptr;
 
   void DelayedHouseKeeping();
+  // Put task in tasks or deadlineTasks, starting its deadline from
+  // ready_time.
+  bool AddReady(Task *task, unsigned ready_time);
+  // Put task in the timer wheel, or straight into tasks if it's already due.
+  void AddDelayed(DelayedTask *task, unsigned now);
+  // Nothing is runnable, sleep until the next delayed task is due or an
+  // interrupt arrives.
+  void Idle();
+  // One iteration of Run().
+  void RunOnce();
 
  public:
   Scheduler();
@@ -86,16 +129,29 @@ class Scheduler {
   bool Queue(PeriodicTask *task,
              void *arg);  // Queued tasks are disabled by default
   // Can NOT be called during interrupt.
+  // Interrupts that queue tasks often should Push() to their own IsrQueue
+  // instead of calling Queue(), that doesn't need interrupts masked.
+  void AddIsrQueue(IsrQueue *queue);
+  // Can NOT be called during interrupt.
   bool EnablePeriodic(PeriodicTask *task);
   // Can NOT be called during interrupt.
   bool DisablePeriodic(PeriodicTask *task);
   void Run();
+#ifdef HITCON_TEST_MODE
+  // Run() until SysTimer::GetTime() reaches time.
+  void RunUntil(unsigned time);
+#endif  // HITCON_TEST_MODE
 
   // Which task is running now? nullptr for nothing's running.
   Task *GetCurrentTask() { return currentTask; }
 
   // How many tasks has run?
   size_t GetTotalTasksRan() { return totalTasks; }
+
+  // How many deadline tasks started after their deadline, and which one did
+  // most recently?
+  size_t GetMissedDeadlines() { return missedDeadlines; }
+  Task *GetLastMissedTask() { return lastMissedTask; }
 };
 
 extern Scheduler scheduler;
@@ -0,0 +1,102 @@
+#ifdef HITCON_TEST_MODE
+
+#include "SimHal.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+namespace sim {
+
+namespace {
+
+struct Interrupt {
+  uint64_t next_fire;
+  uint32_t period;
+  irq_handler_t handler;
+  void *arg;
+};
+
+Interrupt interrupts[kMaxInterrupts];
+size_t interrupt_count = 0;
+uint64_t now = 0;
+int irq_disabled = 0;
+bool in_irq = false;
+
+// The earliest due interrupt, or nullptr if none.
+Interrupt *NextInterrupt() {
+  Interrupt *next = nullptr;
+  for (size_t i = 0; i < interrupt_count; i++) {
+    if (!next || interrupts[i].next_fire < next->next_fire) {
+      next = &interrupts[i];
+    }
+  }
+  return next;
+}
+
+// Run every interrupt due at or before now. Time spent in a handler pushes
+// now further, which may make more interrupts due.
+void FireDue() {
+  if (irq_disabled || in_irq) return;
+  while (true) {
+    Interrupt *irq = NextInterrupt();
+    if (!irq || irq->next_fire > now) break;
+    irq->next_fire += irq->period;
+    in_irq = true;
+    irq->handler(irq->arg);
+    in_irq = false;
+  }
+}
+
+}  // namespace
+
+void Reset() {
+  interrupt_count = 0;
+  now = 0;
+  irq_disabled = 0;
+  in_irq = false;
+}
+
+uint64_t Now() { return now; }
+
+void Spend(uint32_t cycles) {
+  uint64_t target = now + cycles;
+  while (true) {
+    Interrupt *irq = NextInterrupt();
+    if (irq_disabled || in_irq || !irq || irq->next_fire > target) break;
+    if (irq->next_fire > now) now = irq->next_fire;
+    FireDue();
+  }
+  if (target > now) now = target;
+}
+
+bool AddInterrupt(uint64_t first_fire, uint32_t period, irq_handler_t handler,
+                  void *arg) {
+  if (interrupt_count >= kMaxInterrupts) return false;
+  interrupts[interrupt_count++] = {first_fire, period, handler, arg};
+  return true;
+}
+
+void DisableIrq() { irq_disabled++; }
+
+void EnableIrq() {
+  if (irq_disabled) irq_disabled--;
+  FireDue();
+}
+
+void Sleep(unsigned ticks) {
+  // Wake at the tick boundary ticks from now, like the stretched SysTick.
+  constexpr unsigned kMaxSleepTicks = 1u << 20;
+  if (ticks > kMaxSleepTicks) ticks = kMaxSleepTicks;
+  uint64_t target = (now / kCyclesPerTick + ticks) * kCyclesPerTick;
+  Interrupt *irq = NextInterrupt();
+  if (irq && irq->next_fire < target) target = irq->next_fire;
+  if (target > now) now = target;
+  // Called with interrupts masked, whatever's due runs on EnableIrq().
+}
+
+}  // namespace sim
+}  // namespace sched
+}  // namespace service
+}  // namespace hitcon
+
+#endif  // HITCON_TEST_MODE
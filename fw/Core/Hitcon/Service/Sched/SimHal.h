@@ -0,0 +1,63 @@
+#ifndef HITCON_SERVICE_SCHED_SIMHAL_H_
+#define HITCON_SERVICE_SCHED_SIMHAL_H_
+
+#ifdef HITCON_TEST_MODE
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hitcon {
+namespace service {
+namespace sched {
+namespace sim {
+
+/*
+Host side stand-in for the bits of the HAL/CMSIS the scheduler uses, so
+Service/Sched can be built with -DHITCON_TEST_MODE and run on Linux.
+
+Time is virtual and measured in CPU cycles. It only moves when a task calls
+Spend() to model its run time, or when the scheduler sleeps. Simulated
+interrupts fire at the cycle they're due, in between whatever was spending
+time at that point, unless interrupts are masked, in which case they run as
+soon as they're unmasked.
+*/
+
+// HCLK is 12MHz on the badge and SysTick fires every 1ms.
+constexpr uint32_t kCyclesPerTick = 12000;
+constexpr size_t kMaxInterrupts = 8;
+
+typedef void (*irq_handler_t)(void *arg);
+
+// Back to time 0 with no interrupt sources.
+void Reset();
+
+// Current virtual time in cycles.
+uint64_t Now();
+
+// Model the current context running for cycles.
+void Spend(uint32_t cycles);
+
+// Add a periodic interrupt source firing every period cycles, first at
+// first_fire. Returns false if there's no room.
+bool AddInterrupt(uint64_t first_fire, uint32_t period, irq_handler_t handler,
+                  void *arg);
+
+void DisableIrq();
+void EnableIrq();
+
+// SysTimer::Sleep(). Skip ahead until ticks have passed or an interrupt is
+// due, whichever comes first.
+void Sleep(unsigned ticks);
+
+}  // namespace sim
+}  // namespace sched
+}  // namespace service
+}  // namespace hitcon
+
+inline void __disable_irq() { hitcon::service::sched::sim::DisableIrq(); }
+inline void __enable_irq() { hitcon::service::sched::sim::EnableIrq(); }
+inline void __DMB() { __asm__ volatile("" ::: "memory"); }
+
+#endif  // HITCON_TEST_MODE
+
+#endif  // HITCON_SERVICE_SCHED_SIMHAL_H_
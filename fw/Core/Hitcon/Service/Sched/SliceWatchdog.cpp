@@ -0,0 +1,77 @@
+#include "SliceWatchdog.h"
+
+#include <string.h>
+
+#include "Checks.h"
+#include "SysTimer.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+SliceWatchdog slice_watchdog;
+
+void SliceWatchdog::OnStart(Task *task, uint32_t start_cycles) {
+  start = start_cycles;
+  budget = SliceBudget(task->Prio());
+  start_time = SysTimer::GetTime();
+  caught = false;
+  // Last, OnTick() only looks at the rest once this is set.
+  running = task;
+}
+
+void SliceWatchdog::OnEnd(uint32_t end_cycles) {
+  Task *task = running;
+  // OnTick() can't log anymore after this.
+  running = nullptr;
+  uint32_t cycles = end_cycles - start;
+  if (cycles <= budget) return;
+  if (caught) {
+    // Already logged from OnTick(), fill in the full run time.
+    log[head].cycles = cycles;
+  } else {
+    Log(task, cycles);
+  }
+#if defined(HITCON_TEST_MODE) && defined(SCHED_STRICT_BUDGET)
+  my_assert(false);
+#endif
+}
+
+void SliceWatchdog::OnTick() {
+  Task *task = running;
+  if (!task || caught) return;
+  uint32_t cycles = SysTimer::GetCycles() - start;
+  if (cycles > budget) {
+    Log(task, cycles);
+    caught = true;
+  }
+}
+
+OverrunRecord *SliceWatchdog::GetOverrun(size_t i) {
+  if (i >= kOverrunLogSize || i >= overruns) return nullptr;
+  return &log[(head + kOverrunLogSize - i) % kOverrunLogSize];
+}
+
+void SliceWatchdog::Reset() {
+  memset(log, 0, sizeof(log));
+  head = 0;
+  overruns = 0;
+}
+
+void SliceWatchdog::Log(Task *task, uint32_t cycles) {
+  head = (head + 1) % kOverrunLogSize;
+  log[head].task = task;
+  log[head].callback = task->Callback();
+  log[head].cycles = cycles;
+  log[head].start_time = start_time;
+  overruns++;
+}
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+// Called from SysTick_Handler().
+extern "C" void SliceWatchdogTick() {
+  hitcon::service::sched::slice_watchdog.OnTick();
+}
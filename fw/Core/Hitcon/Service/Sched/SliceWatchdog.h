@@ -0,0 +1,102 @@
+#ifndef HITCON_SERVICE_SCHED_SLICEWATCHDOG_H_
+#define HITCON_SERVICE_SCHED_SLICEWATCHDOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SysTimer.h"
+#include "Task.h"
+
+namespace hitcon {
+namespace service {
+namespace sched {
+
+/*
+Slice budget watchdog.
+
+Tasks are never preempted, so one that runs too long delays everything else,
+e.g. the display refill (tearing) or the IR RX pull (buffer overflow). Every
+task gets a budget from its priority band, see SliceBudget(). The scheduler
+checks each run against it when the task returns, and the SysTick handler
+checks the running task every tick, so a task that never returns is still
+caught.
+
+Overruns are kept in a small log, newest first, for the debug app, the USB
+stats channel and the debugger. Build with SCHED_STRICT_BUDGET in test builds
+to assert on any overrun instead.
+
+All times are in SysTimer::GetCycles() units (HCLK), budgets are in ms and
+follow the clock through SysTimer::GetCyclesPerMs().
+*/
+
+constexpr size_t kOverrunLogSize = 4;
+
+// Budget in ms for one run of a task with prio, see Scheduler.h for the bands.
+constexpr uint32_t SliceBudgetMs(unsigned prio) {
+  // Hard deadline tasks must leave room for each other.
+  if (prio < 300) return 1;
+  if (prio < 800) return 2;
+  // keccakf_split() is about 0.7ms, background work should be split like it.
+  return 3;
+}
+
+// The same in cycles.
+inline uint32_t SliceBudget(unsigned prio) {
+  return SliceBudgetMs(prio) * SysTimer::GetCyclesPerMs();
+}
+
+// Layout is also the USB wire format, see UsbLogic. Keep it free of padding.
+struct OverrunRecord {
+  Task *task;
+  task_callback_t callback;
+  // How long the task ran, or had run when a tick caught it if it never
+  // returned.
+  uint32_t cycles;
+  // SysTimer::GetTime() when the task started.
+  uint32_t start_time;
+};
+static_assert(sizeof(OverrunRecord) % 8 == 0);
+
+class SliceWatchdog {
+ public:
+  // Call right before task runs.
+  void OnStart(Task *task, uint32_t start_cycles);
+
+  // Call right after the task started with OnStart() returns.
+  void OnEnd(uint32_t end_cycles);
+
+  // Call from the SysTick interrupt.
+  void OnTick();
+
+  // Total overruns since Reset().
+  uint32_t GetOverrunCount() { return overruns; }
+
+  // i = 0 is the newest, nullptr if there's no such record.
+  OverrunRecord *GetOverrun(size_t i);
+
+  void Reset();
+
+ private:
+  // Written by the scheduler, read by OnTick().
+  Task *volatile running;
+  volatile uint32_t start;
+  volatile uint32_t budget;
+  uint32_t start_time;
+  // OnTick() already logged the running task, its record is log[head].
+  volatile bool caught;
+
+  OverrunRecord log[kOverrunLogSize];
+  // Slot of the newest record.
+  size_t head;
+  uint32_t overruns;
+
+  void Log(Task *task, uint32_t cycles);
+};
+
+extern SliceWatchdog slice_watchdog;
+
+} /* namespace sched */
+} /* namespace service */
+} /* namespace hitcon */
+
+#endif /* HITCON_SERVICE_SCHED_SLICEWATCHDOG_H_ */
@@ -7,7 +7,11 @@
 
 #include "SysTimer.h"
 
+#ifdef HITCON_TEST_MODE
+#include "SimHal.h"
+#else
 #include <main.h>
+#endif
 
 namespace hitcon {
 namespace service {
@@ -21,12 +25,92 @@ SysTimer::~SysTimer() {
   // TODO Auto-generated destructor stub
 }
 
+#ifdef HITCON_TEST_MODE
+
+unsigned SysTimer::GetTime() { return sim::Now() / sim::kCyclesPerTick; }
+
+void SysTimer::StartCycleCounter() {}
+
+uint32_t SysTimer::GetCycles() { return static_cast<uint32_t>(sim::Now()); }
+
+uint32_t SysTimer::GetCyclesPerMs() { return sim::kCyclesPerTick; }
+
+void SysTimer::Sleep(unsigned ticks) { sim::Sleep(ticks); }
+
+#else
+
 unsigned SysTimer::GetTime() {
   //	static unsigned x = 0;
   //	return x++;
   return HAL_GetTick();
 }
 
+void SysTimer::StartCycleCounter() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t SysTimer::GetCycles() { return DWT->CYCCNT; }
+
+uint32_t SysTimer::GetCyclesPerMs() { return SystemCoreClock / 1000; }
+
+void SysTimer::Sleep(unsigned ticks) {
+  // SysTick counts down once per HCLK, LOAD + 1 of them is a tick.
+  uint32_t tick_cycles = SysTick->LOAD + 1;
+  uint32_t max_ticks = SysTick_LOAD_RELOAD_Msk / tick_cycles;
+  if (ticks > max_ticks) ticks = max_ticks;
+  if (ticks <= 1) {
+    // The regular tick will wake us up anyway.
+    __WFI();
+    return;
+  }
+
+  SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+  // Cycles left until the tick we'd have had anyway.
+  uint32_t remaining = SysTick->VAL;
+  if (remaining == 0) remaining = tick_cycles;
+  uint32_t period = remaining + (ticks - 1) * tick_cycles;
+  SysTick->LOAD = period - 1;
+  SysTick->VAL = 0;
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+  __DSB();
+  __WFI();
+
+  // Reading CTRL clears COUNTFLAG, so only read it once.
+  uint32_t ctrl = SysTick->CTRL;
+  SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+  uint32_t elapsed_ticks;
+  uint32_t next_tick;
+  if (ctrl & SysTick_CTRL_COUNTFLAG_Msk) {
+    // Slept the whole way. The pending SysTick interrupt accounts for the last
+    // tick.
+    elapsed_ticks = ticks - 1;
+    next_tick = tick_cycles;
+  } else {
+    // Some other interrupt woke us up.
+    uint32_t elapsed = period - 1 - SysTick->VAL;
+    if (elapsed < remaining) {
+      elapsed_ticks = 0;
+      next_tick = remaining - elapsed;
+    } else {
+      elapsed -= remaining;
+      elapsed_ticks = 1 + elapsed / tick_cycles;
+      next_tick = tick_cycles - elapsed % tick_cycles;
+    }
+  }
+  for (uint32_t i = 0; i < elapsed_ticks; i++) HAL_IncTick();
+
+  // Run until the next tick boundary, then reload the normal period.
+  SysTick->LOAD = next_tick - 1;
+  SysTick->VAL = 0;
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+  SysTick->LOAD = tick_cycles - 1;
+}
+
+#endif  // HITCON_TEST_MODE
+
 } /* namespace sched */
 } /* namespace service */
 } /* namespace hitcon */
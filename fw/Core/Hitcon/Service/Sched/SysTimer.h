@@ -8,6 +8,8 @@
 #ifndef HITCON_SERVICE_SCHED_SYSTIMER_H_
 #define HITCON_SERVICE_SCHED_SYSTIMER_H_
 
+#include <stdint.h>
+
 namespace hitcon {
 namespace service {
 namespace sched {
@@ -17,6 +19,19 @@ class SysTimer {
   SysTimer();
   virtual ~SysTimer();
   static unsigned GetTime();
+
+  // Free running CPU cycle counter (DWT CYCCNT), for profiling. Wraps around
+  // every few minutes so only use differences.
+  static void StartCycleCounter();
+  static uint32_t GetCycles();
+  // GetCycles() per ms, from the HCLK the clock tree is set up for.
+  static uint32_t GetCyclesPerMs();
+
+  // Sleep with WFI until ticks have passed or any interrupt is pending,
+  // stretching SysTick so it doesn't wake us every tick in between. The tick
+  // count is caught up before returning. Must be called with interrupts
+  // disabled, interrupts that arrived during sleep run once they're enabled.
+  static void Sleep(unsigned ticks);
 };
 
 } /* namespace sched */
@@ -15,7 +15,15 @@ Task::~Task() {}
 
 bool Task::operator==(Task &task) { return &task == this; }
 
-bool Task::operator<(Task &task) { return prio < task.prio; }
+bool Task::operator<(Task &task) {
+  // Deadline tasks go before best effort ones, earliest deadline first.
+  if (HasDeadline() != task.HasDeadline()) return HasDeadline();
+  if (HasDeadline() && deadline != task.deadline) {
+    // Wrap around safe.
+    return static_cast<int>(deadline - task.deadline) < 0;
+  }
+  return prio < task.prio;
+}
 
 void Task::Run() { callback(thisptr, arg); }
 
@@ -9,6 +9,7 @@
 #define HITCON_SERVICE_SCHED_TASK_H_
 
 #include <Service/Sched/Checks.h>
+#include <stdint.h>
 
 namespace hitcon {
 namespace service {
@@ -16,18 +17,44 @@ namespace sched {
 
 typedef void (*task_callback_t)(void *thisptr, void *arg);
 
+template <class T, unsigned kBandShift>
+class BucketQueue;
+
 class Task {
  protected:
   unsigned prio;
   task_callback_t callback;
   void *thisptr, *arg;
-  bool in_queue = false;
+  // Slot of this task in the scheduler heap it's currently in, a marker for
+  // the other scheduler queues, or kNotQueued if it's not in any. Maintained
+  // by the queues.
+  unsigned queue_idx;
+  // Intrusive link for BucketQueue.
+  Task *ready_next;
+  // Ticks after becoming runnable by which this task must start, 0 for best
+  // effort tasks.
+  unsigned relative_deadline;
+  // SysTimer::GetTime() by which the current run must start. Only valid while
+  // a deadline task is in the ready queue.
+  unsigned deadline;
+#ifdef SCHED_PROFILE
+  // SysTimer::GetCycles() when this task last became runnable.
+  uint32_t ready_cycles = 0;
+#endif  // SCHED_PROFILE
+
+  template <class T, unsigned kBandShift>
+  friend class BucketQueue;
 
  public:
+  static constexpr unsigned kNotQueued = ~0u;
+  // QueueIdx() of a task waiting in the scheduler's best effort ready queue.
+  static constexpr unsigned kInBucketQueue = kNotQueued - 2;
+
   // For prio, see Scheduler.h
   constexpr Task(unsigned prio, task_callback_t callback, void *thisptr)
       : prio(prio), callback(callback), thisptr(thisptr), arg(nullptr),
-        in_queue(false) {}
+        queue_idx(kNotQueued), ready_next(nullptr), relative_deadline(0),
+        deadline(0) {}
 
   // No copy
   Task(const Task &) = delete;
@@ -43,19 +70,36 @@ class Task {
   void Run();
   void SetArg(void *arg);
 
-  // Must be called whenever entering task or delayedTask queue.
-  // This is for debugging double Add() or Remove().
-  inline void EnterQueue() {
-    if (in_queue) AssertOverflow();
-    in_queue = true;
+  inline unsigned Prio() { return prio; }
+  inline task_callback_t Callback() { return callback; }
+
+  // Make this a deadline task that must start within ticks of becoming
+  // runnable, or a best effort one if ticks is 0. See Scheduler.h. Can NOT be
+  // called while the task is queued.
+  void SetDeadline(unsigned ticks) {
+    my_assert(!IsQueued());
+    relative_deadline = ticks;
   }
+  inline bool HasDeadline() { return relative_deadline != 0; }
+  inline unsigned Deadline() { return deadline; }
 
-  // Must be called whenever leaving task or delayedTask queue.
-  // This is for debugging double Add() or Remove().
-  inline void ExitQueue() {
-    if (!in_queue) AssertOverflow();
-    in_queue = false;
+  // Only for use by Scheduler, when the task enters the ready queue.
+  inline void StartDeadline(unsigned ready_time) {
+    deadline = ready_time + relative_deadline;
   }
+
+  // Is this task in any of the scheduler's queues?
+  inline bool IsQueued() { return queue_idx != kNotQueued; }
+
+  // Only for use by Heap, which keeps this in sync on every move.
+  inline unsigned QueueIdx() { return queue_idx; }
+  inline void SetQueueIdx(unsigned idx) { queue_idx = idx; }
+
+#ifdef SCHED_PROFILE
+  // Only for use by Profiler.
+  inline uint32_t GetReadyCycles() { return ready_cycles; }
+  inline void SetReadyCycles(uint32_t cycles) { ready_cycles = cycles; }
+#endif  // SCHED_PROFILE
 };
 
 } /* namespace sched */
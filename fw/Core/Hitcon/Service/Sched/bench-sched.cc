@@ -0,0 +1,273 @@
+#ifdef HITCON_TEST_MODE
+
+// Replays a badge-like task mix on the host scheduler simulator and reports
+// throughput and per priority latency percentiles.
+//
+// Usage: bench-sched [typical|busy|dispatch] [seconds]
+//
+// Latency is from the moment a task becomes runnable (interrupt fired,
+// Queue() called or wake time reached) to the moment it starts running, in
+// virtual time. Scheduler overhead itself doesn't spend virtual time, so it
+// shows up as host time per dispatch instead. The dispatch scenario only has
+// tasks that queue themselves again, to measure just that.
+
+#include <Service/Sched/Scheduler.h>
+#include <Service/Sched/SimHal.h>
+#include <Service/Sched/SysTimer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace hitcon::service::sched;
+
+namespace {
+
+constexpr uint32_t kCyclesPerUs = sim::kCyclesPerTick / 1000;
+
+struct Stat {
+  const char *name;
+  unsigned prio;
+  std::vector<uint32_t> latencies;
+};
+
+std::vector<Stat *> all_stats;
+
+Stat *NewStat(const char *name, unsigned prio) {
+  Stat *stat = new Stat{name, prio, {}};
+  all_stats.push_back(stat);
+  return stat;
+}
+
+void Record(Stat *stat, uint64_t ready_at) {
+  stat->latencies.push_back(static_cast<uint32_t>(sim::Now() - ready_at));
+}
+
+// A task queued from another task, optionally re-queueing itself to split a
+// long computation into slices.
+struct ChainTask {
+  Stat *stat;
+  uint32_t cost;
+  unsigned slices;
+  unsigned remaining;
+  uint64_t ready_at;
+  Task task;
+  // Called once all slices are done.
+  ChainTask *next;
+
+  ChainTask(const char *name, unsigned prio, uint32_t cost, unsigned slices)
+      : stat(NewStat(name, prio)), cost(cost), slices(slices), remaining(0),
+        ready_at(0), task(prio, (task_callback_t)&ChainTask::Run, this),
+        next(nullptr) {}
+
+  void Start() {
+    // Still busy from the last request.
+    if (remaining) return;
+    remaining = slices;
+    ready_at = sim::Now();
+    scheduler.Queue(&task, nullptr);
+  }
+
+  void Run(void *unused) {
+    Record(stat, ready_at);
+    sim::Spend(cost);
+    if (--remaining) {
+      ready_at = sim::Now();
+      scheduler.Queue(&task, nullptr);
+    } else if (next) {
+      next->Start();
+    }
+  }
+};
+
+// A task queued from an interrupt, e.g. a DMA half/full transfer callback.
+struct IsrTask {
+  Stat *stat;
+  uint32_t cost;
+  uint64_t ready_at;
+  IsrQueue queue;
+  Task task;
+  // Every start_every runs, start the chain, 0 to disable.
+  unsigned start_every;
+  ChainTask *chain;
+  unsigned runs;
+
+  IsrTask(const char *name, unsigned prio, uint32_t cost, unsigned deadline)
+      : stat(NewStat(name, prio)), cost(cost), ready_at(0),
+        task(prio, (task_callback_t)&IsrTask::Run, this), start_every(0),
+        chain(nullptr), runs(0) {
+    task.SetDeadline(deadline);
+  }
+
+  static void Fire(void *arg) {
+    IsrTask *self = reinterpret_cast<IsrTask *>(arg);
+    // Model a short handler.
+    sim::Spend(60);
+    if (!self->task.IsQueued()) self->ready_at = sim::Now();
+    self->queue.Push(&self->task, nullptr);
+  }
+
+  void Run(void *unused) {
+    Record(stat, ready_at);
+    sim::Spend(cost);
+    runs++;
+    if (chain && start_every && runs % start_every == 0) chain->Start();
+  }
+};
+
+// A PeriodicTask, latency is measured against its wake time.
+struct TimerTask {
+  Stat *stat;
+  uint32_t cost;
+  // Every heavy_every runs costs heavy_cost instead, 0 to disable.
+  unsigned heavy_every;
+  uint32_t heavy_cost;
+  unsigned runs;
+  PeriodicTask task;
+  // Started after every run.
+  ChainTask *chain;
+
+  TimerTask(const char *name, unsigned prio, unsigned interval, uint32_t cost,
+            unsigned heavy_every = 0, uint32_t heavy_cost = 0)
+      : stat(NewStat(name, prio)), cost(cost), heavy_every(heavy_every),
+        heavy_cost(heavy_cost), runs(0),
+        task(prio, (task_callback_t)&TimerTask::Run, this, interval),
+        chain(nullptr) {}
+
+  void Start() {
+    scheduler.Queue(&task, nullptr);
+    scheduler.EnablePeriodic(&task);
+  }
+
+  void Run(void *unused) {
+    uint64_t wake =
+        static_cast<uint64_t>(task.WakeTime()) * sim::kCyclesPerTick;
+    Record(stat, std::min(wake, sim::Now()));
+    runs++;
+    bool heavy = heavy_every && runs % heavy_every == 0;
+    sim::Spend(heavy ? heavy_cost : cost);
+    if (chain) chain->Start();
+  }
+};
+
+// Queues itself again every run, keeping the ready queue at a fixed depth.
+struct SpinTask {
+  Task task;
+
+  explicit SpinTask(unsigned prio)
+      : task(prio, (task_callback_t)&SpinTask::Run, this) {}
+
+  void Run(void *unused) {
+    sim::Spend(100);
+    scheduler.Queue(&task, nullptr);
+  }
+};
+
+int RunDispatch(unsigned seconds) {
+  // Fits the scheduler's add queue.
+  SpinTask spin[] = {SpinTask(300), SpinTask(490), SpinTask(600),
+                     SpinTask(800), SpinTask(803), SpinTask(950)};
+  sim::Reset();
+  for (SpinTask &t : spin) scheduler.Queue(&t.task, nullptr);
+  auto host_start = std::chrono::steady_clock::now();
+  scheduler.RunUntil(seconds * 1000);
+  auto host_end = std::chrono::steady_clock::now();
+  double host_ns =
+      std::chrono::duration<double, std::nano>(host_end - host_start).count();
+  size_t dispatched = scheduler.GetTotalTasksRan();
+  printf("scenario dispatch, %u virtual seconds\n", seconds);
+  printf("dispatched %zu tasks, %.1f host ns/dispatch\n", dispatched,
+         host_ns / dispatched);
+  return 0;
+}
+
+uint32_t Percentile(const std::vector<uint32_t> &v, double p) {
+  if (v.empty()) return 0;
+  size_t idx = static_cast<size_t>(p * (v.size() - 1));
+  return v[idx];
+}
+
+void Report(const char *scenario, unsigned seconds, double host_ns) {
+  size_t dispatched = scheduler.GetTotalTasksRan();
+  printf("scenario %s, %u virtual seconds\n", scenario, seconds);
+  printf("dispatched %zu tasks, %.1f tasks/s, %.1f host ns/dispatch\n",
+         dispatched, static_cast<double>(dispatched) / seconds,
+         host_ns / dispatched);
+  printf("missed deadlines %zu, slice overruns %u\n",
+         scheduler.GetMissedDeadlines(), slice_watchdog.GetOverrunCount());
+  printf("%-12s %5s %8s %9s %9s %9s %9s\n", "task", "prio", "runs", "p50(us)",
+         "p90(us)", "p99(us)", "max(us)");
+  std::sort(all_stats.begin(), all_stats.end(),
+            [](Stat *a, Stat *b) { return a->prio < b->prio; });
+  for (Stat *stat : all_stats) {
+    std::vector<uint32_t> &v = stat->latencies;
+    std::sort(v.begin(), v.end());
+    printf("%-12s %5u %8zu %9u %9u %9u %9u\n", stat->name, stat->prio,
+           v.size(), Percentile(v, 0.5) / kCyclesPerUs,
+           Percentile(v, 0.9) / kCyclesPerUs,
+           Percentile(v, 0.99) / kCyclesPerUs,
+           (v.empty() ? 0 : v.back()) / kCyclesPerUs);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *scenario = argc > 1 ? argv[1] : "typical";
+  unsigned seconds = argc > 2 ? atoi(argv[2]) : 60;
+  bool busy = strcmp(scenario, "busy") == 0;
+  if (strcmp(scenario, "dispatch") == 0) return RunDispatch(seconds);
+  if (!busy && strcmp(scenario, "typical") != 0) {
+    fprintf(stderr, "usage: %s [typical|busy|dispatch] [seconds]\n",
+            argv[0]);
+    return 1;
+  }
+
+  // Priorities follow the real services. The busy scenario receives packets
+  // back to back and hashes back to back, typical receives about one packet a
+  // second and hashes a bit every 200ms.
+  IsrTask display("display", 169, 3000, 10);
+  IsrTask ir_tx("ir_tx", 100, 800, 5);
+  IsrTask ir_rx_pull("ir_rx_pull", 150, 1200, 5);
+  ChainTask ir_packet("ir_packet", 500, 300, 1);
+  ChainTask hash("hash", 880, 8000, 30);
+  TimerTask xboard("xboard", 300, 10, 300);
+  TimerTask ir_routine("ir_routine", 600, 22, 200);
+  TimerTask imu("imu", 850, 500, 4000);
+  TimerTask hash_kick("hash_kick", 900, busy ? 1 : 200, 50);
+  TimerTask nv_storage("nv_storage", 950, 100, 500);
+  TimerTask flash("flash", 980, 20, 200, 50, 20000);
+
+  // RX DMA runs decode as they go, a full size packet takes 16 runs.
+  ir_rx_pull.chain = &ir_packet;
+  ir_rx_pull.start_every = busy ? 16 : 148;
+  hash_kick.chain = &hash;
+
+  sim::Reset();
+  // DMA rates: display 1600Hz/32 transfers, IR TX 38kHz/256 pulses and IR RX
+  // 9.5kHz/64 samples.
+  sim::AddInterrupt(1000, 20 * sim::kCyclesPerTick, &IsrTask::Fire, &display);
+  sim::AddInterrupt(2000, 12000000ull * 256 / 38000, &IsrTask::Fire, &ir_tx);
+  sim::AddInterrupt(3000, 12000000ull * 64 / 9500, &IsrTask::Fire,
+                    &ir_rx_pull);
+  for (IsrTask *t : {&display, &ir_tx, &ir_rx_pull}) {
+    scheduler.AddIsrQueue(&t->queue);
+  }
+  for (TimerTask *t :
+       {&xboard, &ir_routine, &imu, &hash_kick, &nv_storage, &flash}) {
+    t->Start();
+  }
+
+  auto host_start = std::chrono::steady_clock::now();
+  scheduler.RunUntil(seconds * 1000);
+  auto host_end = std::chrono::steady_clock::now();
+  Report(scenario, seconds,
+         std::chrono::duration<double, std::nano>(host_end - host_start)
+             .count());
+  return 0;
+}
+
+#endif  // HITCON_TEST_MODE
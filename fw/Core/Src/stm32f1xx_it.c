@@ -46,6 +46,7 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
+void SliceWatchdogTick(void);
 
 /* USER CODE END PFP */
 
@@ -196,6 +197,7 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  SliceWatchdogTick();
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -1,4 +1,5 @@
 import math
+import struct
 import hid
 
 vendor_id = 1155
@@ -49,6 +50,82 @@ def send_badusb_script(script):
         if len(datatosend) - 8 != i:
             tmp=device.read(8)
 
+#Scheduler profiler, firmware must be built with SCHED_PROFILE.
+#Returns a list of dicts, one per task seen. Map "task" to a symbol with the
+#firmware's .map file.
+SCHED_STATS_SLOTS = 16
+SCHED_STATS_PAGES = 8
+def read_sched_stats():
+    stats = []
+    for slot in range(SCHED_STATS_SLOTS):
+        raw = []
+        for page in range(SCHED_STATS_PAGES):
+            send_command([0x08, slot, page])
+            raw += device.read(8)
+        fields = struct.unpack('<IIQIIQ16H', bytes(raw))
+        if fields[0] == 0:
+            continue
+        stats.append({
+            'task': fields[0],
+            'count': fields[1],
+            'total_cycles': fields[2],
+            'max_cycles': fields[3],
+            'max_latency': fields[4],
+            'total_latency': fields[5],
+            'hist': list(fields[6:]),
+        })
+    return stats
+
+#Slice budget overruns, newest first. Works without SCHED_PROFILE.
+SCHED_OVERRUN_SLOT = 0x80
+SCHED_OVERRUN_LOG_SIZE = 4
+SCHED_COUNT_SLOT = 0xFE
+def read_sched_overruns():
+    send_command([0x08, SCHED_COUNT_SLOT, 0])
+    overruns, missed_deadlines = struct.unpack('<II', bytes(device.read(8)))
+    log = []
+    for i in range(min(overruns, SCHED_OVERRUN_LOG_SIZE)):
+        raw = []
+        for page in range(2):
+            send_command([0x08, SCHED_OVERRUN_SLOT + i, page])
+            raw += device.read(8)
+        fields = struct.unpack('<IIII', bytes(raw))
+        log.append({
+            'task': fields[0],
+            'callback': fields[1],
+            'cycles': fields[2],
+            'start_time': fields[3],
+        })
+    return {'overruns': overruns, 'missed_deadlines': missed_deadlines,
+            'log': log}
+
+def reset_sched_stats():
+    send_command([0x08, 0xFF, 0x00])
+    device.read(8)
+
+#IR stack counters, IrStats in fw/Core/Hitcon/Logic/IrStats.h, in its order.
+#mac_wait_* are in RX bytes of 8 samples, about 0.84ms each.
+IR_STATS_FIELDS = [
+    'tx_frames', 'tx_chained', 'tx_collisions', 'mac_releases',
+    'mac_wait_bytes', 'mac_wait_max', 'rx_headers', 'rx_invalid_size',
+    'rx_invalid_data', 'rx_invalid_fec', 'rx_bad_size', 'rx_fec_failed',
+    'rx_fec_fixed', 'rx_bad_checksum', 'rx_packets', 'rx_overrun',
+    'tx_queue_full', 'rx_duplicates', 'retx_queue_full', 'retx_acked',
+    'retx_resent', 'retx_exhausted',
+]
+def read_ir_stats():
+    raw = []
+    for page in range((len(IR_STATS_FIELDS) * 4 + 7) // 8):
+        send_command([0x09, page])
+        raw += device.read(8)
+    fields = struct.unpack('<%dI' % len(IR_STATS_FIELDS),
+                           bytes(raw[:len(IR_STATS_FIELDS) * 4]))
+    return dict(zip(IR_STATS_FIELDS, fields))
+
+def reset_ir_stats():
+    send_command([0x09, 0xFF])
+    device.read(8)
+
 def send_command(command):
     k=device.write(command)
     return k